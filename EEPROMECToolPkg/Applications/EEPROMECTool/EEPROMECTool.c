@@ -34,16 +34,46 @@
 
   Hotkeys
   -------
-  PgUp/PgDn : Bank 切換
+  PgUp/PgDn : Bank 切換 (閒置時會預讀相鄰 bank 到 cache，切換時直接使用)
   TAB       : 顯示模式 BYTE/WORD/DWORD
   Arrow     : 移動游標
   ENTER     : 依顯示模式寫入 (LE)，並 read-back verify
-  R         : 刷新
-  I         : 切換 Access (PortIO / IndexIO-ENE / IndexIO-Nuvoton / IndexIO-ITE)
+  R         : 刷新 (強制重讀，並更新 bank cache)
+  H         : 從游標輸入任意長度 hex 字串 (可貼上 UUID/MAC)，一次寫入 + 一次 verify
+  A         : 從游標輸入 ASCII 字串 (序號/Asset tag)，可補齊欄位長度 (F1 選 pad) 與 NUL 結尾 (F2)
+  F         : 從游標開始 fill (<len> <pattern>)，相同的 byte 不重寫
+  C         : Bank 間 copy (<src>:<off> <dst>:<off> <len>)，只寫入不同的 byte
+  N         : Snapshot 歷史 (每次 refresh/寫入自動記錄，每 bank 保留最近 8 份)，diff 兩份或 revert
+  E         : EEPROM / EC RAM 檢視切換 (EC RAM 只讀取可見列 + read-ahead)
+  S         : 背景 scrub 頻寬 (Off/4/16/64 B/s)，被外部改寫的 byte 以紅字標示
+  V         : Vote 模式：可疑的 byte (OBF 慢、timeout 重試、與 cache 不同) 重讀並取多數
+  I         : 切換 Access (PortIO / IndexIO-ENE / IndexIO-Nuvoton / IndexIO-ITE)，
+              略過 LPC/eSPI bridge (00:1F.0) 沒有 decode 的 backend
   F1        : PortIO 改 60/64
   F2        : PortIO 改 62/66
+  D         : Diagnostics (scheduler / cache 統計、latency 直方圖 (EC / host SMI)、LPC/eSPI I/O decode)
+  L         : Event log (timeout、切換/寫入結果；最後 3 筆顯示在畫面下方)
   ESC       : 離開
 
+  Command line (不進 UI)
+  ----------------------
+  EEPROMECTool.efi [-a portio|ene|nuvoton|ite] [-p 62|60] [-pw <cmd> <pagesize>] [-pwbuf <lenbuf> <databuf>]
+                   [-vote on|off] [-decode on|off] [-lat on|off] [-j <file|->] [-l <logfile>] [<command> [args]]
+    (未指定 -a 時依 SIO 2E/4E 或 EC RAM 中的 chip ID 自動選擇 ENE/Nuvoton/ITE profile)
+    run [-n|-r] <script> : 執行 batch script (格式見 "Batch script" 區段)，-r 從 <script>.prg 續跑
+    fill <bank>:<off> <len> <pattern>
+    copy <srcbank>:<off> <dstbank>:<off> <len>
+    import [-n] <file> : Intel HEX / S-record，只寫入與目前內容不同的 byte
+    provision [-n] <manifest> <smbios|<bank>:<off>:<len>> : 依 SMBIOS 序號或 EEPROM 欄位查 manifest 並寫入
+    export <bin|ihex|c|hexdump> <file> [all|<bank>|ecram]
+    multi [-n] <ec> <file> [<ec> <file> ...] : 多顆 EC 各寫一個映像檔，交錯執行
+                                              (ec: portio[:62|60], ene|nuvoton|ite[:<base>])
+    bench [render [<frames>]] : image size、啟動到第一個 EC transaction 的時間、讀取 bank 0 的時間；
+                                render 則不存取 EC，量測每個畫面的時間與 ConOut 呼叫數
+
+  EEPROMECToolCli.efi (EEPROMECToolCli.inf，定義 EEPROMEC_CLI_ONLY) 只含命令列，
+  不編入 UI；不帶指令時印出 usage。
+
 **/
 
 #include <Uefi.h>
@@ -56,6 +86,15 @@
 #include <Library/BaseMemoryLib.h>
 #include <Library/PrintLib.h>
 #include <Library/IoLib.h>
+#include <Library/PciLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/ShellLib.h>
+#include <Library/DevicePathLib.h>
+
+#include <Protocol/ShellParameters.h>
+#include <Protocol/LoadedImage.h>
+#include <Protocol/GraphicsOutput.h>
+#include <Guid/SmBios.h>
 
 // ===== EEPROM/EC command =====
 #define EC_CMD_EEPROM_BANK_NUM  0x42
@@ -63,6 +102,9 @@
 #define EC_CMD_EEPROM_WRITE     0x4D
 
 #define EEPROM_BANK_MAX         7
+#define EEPROM_PAGE_MIN         8     // page sizes accepted from -pw: powers of two in between
+#define EEPROM_PAGE_MAX         64    // largest page-write burst we accept from a profile
+#define PAGE_WRITE_FAIL_MAX     3     // consecutive page-write failures before falling back
 
 // ===== Port I/O (ACPI EC / 8042) =====
 #define EC_STS_OBF              (1u << 0)   // Output Buffer Full
@@ -73,6 +115,9 @@
 #define EC_ACPI_DATA_PORT       0x62
 #define EC_ACPI_CMD_PORT        0x66
 
+// ===== ACPI EC RAM access (62/66) =====
+#define EC_CMD_ACPI_READ        0x80
+
 // ===== Index I/O Control Bits =====
 #define CMD_CNTL_PROCESSING     (1u << 0)
 #define CMD_CNTL_START          (1u << 1)
@@ -122,15 +167,114 @@ typedef struct {
   UINT16 WriteDataBuf;
   UINT16 ReadAddrBuf;
   UINT16 BankBuf;
+
+  // EEPROM page write (PageWriteCmd == 0: firmware has none, use byte writes)
+  //   PortIO   : Cmd, Addr, Count, Data[0..Count-1] through the data port
+  //   Index I/O: Cmd -> DataOfCmdBuffer, Addr -> WriteAddrBuf,
+  //              Count -> PageLenBuf, Data -> PageDataBuf[0..Count-1]
+  UINT8  PageWriteCmd;
+  UINT8  PageSize;             // bytes per EEPROM page (power of two), writes never cross it
+  UINT16 PageLenBuf;           // per vendor, -pwbuf overrides
+  UINT16 PageDataBuf;
 } EC_PROFILE;
 
 STATIC EC_PROFILE mEc;
 
+// EC identified by ChipSelectProfile (Found FALSE: nothing answered)
+STATIC struct {
+  BOOLEAN        Found;
+  EC_ACCESS_TYPE Access;
+  CONST CHAR16   *Vendor;
+  UINT16         Id;
+  UINT8          Rev;
+  CONST CHAR16   *Source;          // where the ID was read
+  UINT64         Us;               // time spent probing
+} mChip;
+
+// -a given: keep the user's profile even if the chip says otherwise
+STATIC BOOLEAN mAccessGiven;
+
+// -pw <cmd> <size>: page-write capability of the EC firmware on this board
+STATIC UINT8      mPageWriteCmd  = 0;
+STATIC UINT8      mPageWriteSize = 0;
+// -pwbuf <lenbuf> <databuf>: Index I/O page mailbox when the firmware differs (0: profile's)
+STATIC UINT16     mPageLenBuf    = 0;
+STATIC UINT16     mPageDataBuf   = 0;
+
+#ifndef EEPROMEC_CLI_ONLY
 // current UI state
 STATIC UINT8     mBank     = 0;
 STATIC UINT8     mDump[256];
 STATIC UINT8     mCursor   = 0;
 STATIC DISP_MODE mDispMode = DISP_BYTE;
+STATIC INT32     mRowLine[ROWS];          // console line of each hex row (for partial redraws)
+STATIC BOOLEAN   mDumpStale = TRUE;       // mDump not (yet) read from the current backend
+STATIC BOOLEAN   mProbing   = FALSE;      // background reread of mBank queued, see RefreshStart
+
+// Pending (not yet committed) bytes shown in the ASCII column, see UiAsciiAtCursor
+STATIC struct {
+  BOOLEAN Active;
+  UINT8   Off;
+  UINT16  Len;
+  UINT8   Data[256];
+} mPreview;
+
+STATIC CONST UINT8  mAsciiPad[]     = { ' ', 0x00, 0xFF };
+STATIC CONST CHAR16 *mAsciiPadName[] = { L"' '", L"00", L"FF" };
+#endif // EEPROMEC_CLI_ONLY
+
+// ---------- Bank cache (filled by RefreshDump and the idle prefetcher) ----------
+#define PREFETCH_RADIUS         2     // prefetch mBank +/-1 .. +/-PREFETCH_RADIUS
+
+STATIC UINT8   mCache[EEPROM_BANK_MAX + 1][256];
+STATIC UINT8   mCacheValid[EEPROM_BANK_MAX + 1][256 / 8];  // 1 bit per byte
+STATIC INTN    mEcBankSel     = -1;     // bank currently selected in EC, -1 = unknown
+STATIC BOOLEAN mPageWriteOk   = FALSE;  // a page write succeeded on this backend
+STATIC UINT8   mPageFailRun   = 0;      // consecutive failed page writes
+STATIC BOOLEAN mPrefetchHold  = FALSE;  // set after a prefetch error, cleared by a good refresh
+
+// ---------- Background scrub (detects EEPROM changes made behind our back) ----------
+#define SCRUB_STRIDE            97    // odd -> visits all 8*256 positions before repeating
+#define SCRUB_RATE_DEFAULT      16    // bytes per second
+
+STATIC UINT8   mExtMod[EEPROM_BANK_MAX + 1][256 / 8];  // 1 = changed externally since cached
+
+#ifndef EEPROMEC_CLI_ONLY
+STATIC CONST UINT32 mScrubRates[] = { 0, 4, SCRUB_RATE_DEFAULT, 64 };
+
+STATIC UINT32  mScrubRate   = SCRUB_RATE_DEFAULT;       // bytes per second, 0 = off
+STATIC BOOLEAN mNeedRender  = FALSE;                    // background work changed what is on screen
+#endif // EEPROMEC_CLI_ONLY
+
+#ifndef EEPROMEC_CLI_ONLY
+// ---------- EC RAM paged view ----------
+#define RAM_PAGE_SLOTS          48    // row cache size (rows of COLS bytes)
+#define RAM_READAHEAD_ROWS      4     // rows read ahead above and below the viewport
+
+typedef enum {
+  VIEW_EEPROM = 0,
+  VIEW_ECRAM
+} VIEW_MODE;
+
+typedef struct {
+  BOOLEAN InUse;
+  UINT16  ValidMask;      // 1 bit per byte in Data
+  UINT32  Row;
+  UINT32  LastUse;
+  UINT8   Data[COLS];
+} RAM_PAGE;
+
+STATIC VIEW_MODE mView             = VIEW_EEPROM;
+STATIC RAM_PAGE  mRamPages[RAM_PAGE_SLOTS];
+STATIC UINT32    mRamTick          = 0;
+STATIC UINT32    mRamTop           = 0;       // first visible row
+STATIC UINT32    mRamCursor        = 0;       // absolute EC RAM address
+STATIC BOOLEAN   mRamReadAheadHold = FALSE;
+
+STATIC struct {
+  UINT32 BytesRead;
+  UINT32 Evicted;
+} mRamStats;
 
 // ---------- Color helpers ----------
 STATIC UINTN mAttrDefault = 0;
@@ -139,17 +283,610 @@ STATIC VOID SetAttr(IN UINTN Attr) { gST->ConOut->SetAttribute(gST->ConOut, Attr
 STATIC VOID AttrDefault(VOID) { SetAttr(mAttrDefault); }
 STATIC VOID AttrGreenText(VOID) { SetAttr(EFI_TEXT_ATTR(EFI_GREEN, EFI_BLACK)); }
 STATIC VOID AttrCursorBlueBg(VOID) { SetAttr(EFI_TEXT_ATTR(EFI_WHITE, EFI_BLUE)); }
+STATIC VOID AttrExtModified(VOID) { SetAttr(EFI_TEXT_ATTR(EFI_LIGHTRED, EFI_BLACK)); }
+STATIC VOID AttrPending(VOID) { SetAttr(EFI_TEXT_ATTR(EFI_BLACK, EFI_BROWN)); }
+STATIC VOID AttrCell(VOID) { if (mDumpStale) SetAttr(EFI_TEXT_ATTR(EFI_DARKGRAY, EFI_BLACK)); else AttrDefault(); }
 
 STATIC VOID PrintParenGreen(IN CONST CHAR16 *Text) {
   AttrGreenText();
   Print(L"(%s)", Text);
   AttrDefault();
 }
+#endif // EEPROMEC_CLI_ONLY
+
+// ---------- Time helpers (TSC, calibrated against Stall) ----------
+STATIC UINT64 mTscPerUs = 1;
+STATIC UINT64 mStartUs;
+STATIC UINT64 mEntryTsc;          // UefiMain entry, before calibration
+STATIC UINT64 mFirstXferTsc;      // first EC transaction dispatched, 0 = none yet
+
+STATIC
+UINT64
+NowUs (
+  VOID
+  )
+{
+  return DivU64x64Remainder(AsmReadTsc(), mTscPerUs, NULL);
+}
+
+STATIC
+VOID
+TimeInit (
+  VOID
+  )
+{
+  UINT64 t0 = AsmReadTsc();
+  gBS->Stall(10000);
+  mTscPerUs = DivU64x32(AsmReadTsc() - t0, 10000);
+  if (mTscPerUs == 0) mTscPerUs = 1;
+  mStartUs = NowUs();
+}
+
+// =======================================================
+//            Structured output (JSON Lines, CLI)
+// =======================================================
+//
+// -j <file|-> turns CLI output into one JSON object per line:
+//   {"ev":"read","t":<us>,"bank":0,"off":16,"data":"0a0b..."}
+//   {"ev":"write","t":..,"op":"fill","bytes":..,"blocks":..,"cycles":..,"skipped":..,"mismatch":..,"status":".."}
+//   {"ev":"mismatch","t":..,"bank":..,"off":..,"expect":..,"read":..}
+//   {"ev":"error","t":..,"op":"..","line":..,"status":".."}
+//   {"ev":"cost","t":..,"cmd":"..","us":..,"xfer":..,"bank_switches":..,"write_cycles":..,"ec_errors":..}
+//   {"ev":"msg","t":..,"text":".."}          (everything else)
+// Records are appended to an OUT_BUF with table-driven hex/decimal
+// conversion and written out when it fills or the command ends.
+
+// ---------- Buffered byte sink (file or console) ----------
+
+#define OUT_BUF_SIZE            4096
+
+typedef struct {
+  SHELL_FILE_HANDLE Fh;       // NULL: console
+  EFI_STATUS        Status;   // first write error
+  UINTN             Len;
+  CHAR8             Buf[OUT_BUF_SIZE];
+} OUT_BUF;
+
+STATIC CONST CHAR8 mHexDigit[] = "0123456789abcdef";
+STATIC CHAR8       mHexPair[256][2];    // byte -> two lowercase hex digits
+
+STATIC
+VOID
+HexTableInit (
+  VOID
+  )
+{
+  for (UINTN i = 0; i < 256; i++) {
+    mHexPair[i][0] = mHexDigit[i >> 4];
+    mHexPair[i][1] = mHexDigit[i & 0xF];
+  }
+}
+
+STATIC
+VOID
+OutFlush (
+  IN OUT OUT_BUF *Ob
+  )
+{
+  CHAR16     Wide[129];
+  UINTN      n;
+  EFI_STATUS Status;
+
+  if (Ob->Len == 0) return;
+
+  if (Ob->Fh != NULL) {
+    n      = Ob->Len;
+    Status = ShellWriteFile(Ob->Fh, &n, Ob->Buf);
+    if (!EFI_ERROR(Ob->Status)) Ob->Status = EFI_ERROR(Status) ? Status : (n != Ob->Len) ? EFI_VOLUME_FULL : EFI_SUCCESS;
+  } else {
+    for (UINTN i = 0; i < Ob->Len; i += n) {
+      n = MIN(Ob->Len - i, ARRAY_SIZE(Wide) - 1);
+      for (UINTN k = 0; k < n; k++) Wide[k] = (CHAR16)Ob->Buf[i + k];
+      Wide[n] = 0;
+      gST->ConOut->OutputString(gST->ConOut, Wide);
+    }
+  }
+  Ob->Len = 0;
+}
+
+STATIC
+VOID
+OutC (
+  IN OUT OUT_BUF *Ob,
+  IN     CHAR8   c
+  )
+{
+  if (Ob->Len == OUT_BUF_SIZE) OutFlush(Ob);
+  Ob->Buf[Ob->Len++] = c;
+}
+
+// Raw bytes, copied in buffer-sized pieces
+STATIC
+VOID
+OutBytes (
+  IN OUT OUT_BUF     *Ob,
+  IN     CONST VOID  *Data,
+  IN     UINTN       Len
+  )
+{
+  CONST UINT8 *p = Data;
+
+  while (Len > 0) {
+    UINTN n;
+    if (Ob->Len == OUT_BUF_SIZE) OutFlush(Ob);
+    n = MIN(Len, OUT_BUF_SIZE - Ob->Len);
+    CopyMem(&Ob->Buf[Ob->Len], p, n);
+    Ob->Len += n;
+    p       += n;
+    Len     -= n;
+  }
+}
+
+STATIC
+VOID
+OutRaw (
+  IN OUT OUT_BUF     *Ob,
+  IN     CONST CHAR8 *s
+  )
+{
+  while (*s != 0) OutC(Ob, *s++);
+}
+
+STATIC
+VOID
+OutHex8 (
+  IN OUT OUT_BUF *Ob,
+  IN     UINT8   v
+  )
+{
+  if (Ob->Len + 2 > OUT_BUF_SIZE) OutFlush(Ob);
+  Ob->Buf[Ob->Len++] = mHexPair[v][0];
+  Ob->Buf[Ob->Len++] = mHexPair[v][1];
+}
+
+// ---------- JSON Lines ----------
+
+STATIC BOOLEAN mJson;
+STATIC OUT_BUF mJsonOut;      // Fh NULL: stdout
+
+STATIC
+VOID
+JsonFlush (
+  VOID
+  )
+{
+  OutFlush(&mJsonOut);
+}
+
+STATIC
+VOID
+JsonPutC (
+  IN CHAR8 c
+  )
+{
+  OutC(&mJsonOut, c);
+}
+
+STATIC
+VOID
+JsonPutRaw (
+  IN CONST CHAR8 *s
+  )
+{
+  OutRaw(&mJsonOut, s);
+}
+
+STATIC
+VOID
+JsonPutU (
+  IN UINT64 v
+  )
+{
+  CHAR8 Tmp[20];
+  UINTN n = 0;
+
+  do {
+    Tmp[n++] = mHexDigit[v % 10];
+    v /= 10;
+  } while (v != 0);
+  while (n > 0) JsonPutC(Tmp[--n]);
+}
+
+// Quoted, escaped; CHAR16 text is narrowed (non-ASCII -> '?')
+STATIC
+VOID
+JsonPutStr16 (
+  IN CONST CHAR16 *s
+  )
+{
+  JsonPutC('"');
+  for (; *s != 0; s++) {
+    CHAR16 c = *s;
+    if (c == L'"' || c == L'\\') { JsonPutC('\\'); JsonPutC((CHAR8)c); }
+    else if (c == L'\n')         { JsonPutC('\\'); JsonPutC('n'); }
+    else if (c < 0x20)           { JsonPutRaw("\\u00"); JsonPutC(mHexDigit[c >> 4]); JsonPutC(mHexDigit[c & 0xF]); }
+    else                         JsonPutC((c <= 0x7E) ? (CHAR8)c : '?');
+  }
+  JsonPutC('"');
+}
+
+STATIC
+VOID
+JsonBegin (
+  IN CONST CHAR8 *Ev
+  )
+{
+  JsonPutRaw("{\"ev\":\"");
+  JsonPutRaw(Ev);
+  JsonPutRaw("\",\"t\":");
+  JsonPutU(NowUs() - mStartUs);
+}
+
+STATIC
+VOID
+JsonKeyU (
+  IN CONST CHAR8 *Key,
+  IN UINT64      v
+  )
+{
+  JsonPutRaw(",\"");
+  JsonPutRaw(Key);
+  JsonPutRaw("\":");
+  JsonPutU(v);
+}
+
+STATIC
+VOID
+JsonKeyS (
+  IN CONST CHAR8  *Key,
+  IN CONST CHAR16 *s
+  )
+{
+  JsonPutRaw(",\"");
+  JsonPutRaw(Key);
+  JsonPutRaw("\":");
+  JsonPutStr16(s);
+}
+
+STATIC
+VOID
+JsonKeyStatus (
+  IN EFI_STATUS Status
+  )
+{
+  CHAR16 Text[48];
+
+  UnicodeSPrint(Text, sizeof(Text), L"%r", Status);
+  JsonKeyS("status", Text);
+}
+
+STATIC
+VOID
+JsonEnd (
+  VOID
+  )
+{
+  JsonPutRaw("}\n");
+}
+
+STATIC
+VOID
+EvRead (
+  IN UINTN       Bank,
+  IN UINTN       Off,
+  IN UINTN       Len,
+  IN CONST UINT8 *Data
+  )
+{
+  JsonBegin("read");
+  JsonKeyU("bank", Bank);
+  JsonKeyU("off", Off);
+  JsonPutRaw(",\"data\":\"");
+  for (UINTN i = 0; i < Len; i++) OutHex8(&mJsonOut, Data[i]);
+  JsonPutC('"');
+  JsonEnd();
+}
+
+STATIC
+VOID
+EvMismatch (
+  IN UINTN Bank,
+  IN UINTN Off,
+  IN UINT8 Expect,
+  IN UINT8 Read
+  )
+{
+  JsonBegin("mismatch");
+  JsonKeyU("bank", Bank);
+  JsonKeyU("off", Off);
+  JsonKeyU("expect", Expect);
+  JsonKeyU("read", Read);
+  JsonEnd();
+}
+
+// Line 0: not tied to a script line
+STATIC
+VOID
+EvError (
+  IN CONST CHAR16 *Op,
+  IN UINTN        Line,
+  IN EFI_STATUS   Status
+  )
+{
+  JsonBegin("error");
+  JsonKeyS("op", Op);
+  if (Line != 0) JsonKeyU("line", Line);
+  JsonKeyStatus(Status);
+  JsonEnd();
+}
+
+// Human-readable CLI message; a "msg" record in JSON mode
+STATIC
+VOID
+EFIAPI
+MsgPrint (
+  IN CONST CHAR16 *Fmt,
+  ...
+  )
+{
+  VA_LIST Args;
+  CHAR16  Text[256];
+  UINTN   n;
+
+  VA_START(Args, Fmt);
+  n = UnicodeVSPrint(Text, sizeof(Text), Fmt, Args);
+  VA_END(Args);
+
+  if (!mJson) {
+    Print(L"%s", Text);
+    return;
+  }
+
+  while (n > 0 && Text[n - 1] == L'\n') Text[--n] = 0;
+  JsonBegin("msg");
+  JsonKeyS("text", Text);
+  JsonEnd();
+}
+
+// =======================================================
+//                  Event log (ring buffer)
+// =======================================================
+//
+// Transaction paths and the key loop never Print. They append a fixed-size
+// record (severity, timestamp, code, numeric args) to a preallocated ring;
+// text is produced only when a record is shown: the last LOG_PANE_LINES
+// under the hex view, the whole ring on the L screen, or in batches of
+// LOG_SINK_BATCH to the -l file sink. The CLI drains what is left to the
+// console (or JSON) when the command ends.
+
+#define LOG_RING_SIZE           256
+#define LOG_ARGS                5
+#define LOG_PANE_LINES          3
+#define LOG_SINK_BATCH          32
+#define LOG_TEXT_MAX            160
+
+typedef enum {
+  LOG_INFO = 0,
+  LOG_WARN,
+  LOG_ERROR
+} LOG_SEV;
+
+typedef enum {
+  LOG_INDEX_TIMEOUT = 0,
+  LOG_BANK_SWITCH_FAILED,
+  LOG_PORT_SWITCH_FAILED,
+  LOG_PORTIO_ONLY,
+  LOG_ACCESS_REFRESH_FAILED,
+  LOG_REFRESH_FAILED,
+  LOG_WRITE_FAILED,
+  LOG_WRITE_OK,
+  LOG_ECRAM_READ_ONLY,
+  LOG_PROBE_FAILED,
+  LOG_PROBE_CACHE_OK,
+  LOG_PROBE_CACHE_STALE,
+  LOG_DECODE_SKIPPED,
+  LOG_CHIP_DETECTED,
+  LOG_LAT_HOST_SMI,
+  LOG_LAT_EC_SLOW,
+  LOG_LAT_UNATTRIBUTED,
+  LOG_CODE_COUNT
+} LOG_CODE;
+
+typedef struct {
+  UINT64 TimeUs;
+  UINT32 Seq;
+  UINT8  Sev;       // LOG_SEV
+  UINT8  Code;      // LOG_CODE
+  UINT16 Reserved;
+  UINT64 Arg[LOG_ARGS];
+} LOG_REC;
+
+// Format per code; args are consumed in order
+STATIC CONST CHAR16 *mLogFmt[LOG_CODE_COUNT] = {
+  L"IndexIO timeout: Ctl[0x%04x]=0x%02x mask 0x%02x target 0x%02x (base 0x%04x)",
+  L"Switch to bank %u failed: %r",
+  L"Switch to port %x failed: %r",
+  L"F1/F2 only work in PortIO mode",
+  L"Access switch refresh failed: %r",
+  L"Refresh failed: %r",
+  L"Write failed @Bank%u Addr 0x%02x (size=%u): %r",
+  L"Write OK @Bank%u Addr 0x%02x (size=%u)",
+  L"EC RAM view is read-only",
+  L"Initial refresh failed: %r (F1/F2: port, I: access, R: retry)",
+  L"Backend OK: %u sampled bytes match the cache",
+  L"Backend disagrees with the cache at Bank%u Addr 0x%02x (0x%02x, cached 0x%02x): rereading",
+  L"I/O 0x%04x is not decoded by the LPC/eSPI bridge: backend skipped",
+  L"EC chip ID 0x%04x rev 0x%02x (Access %u) identified in %u us",
+  L"Slow %c Bank%u Addr 0x%02x: %u us, host SMI (%u SMIs during the transaction)",
+  L"Slow %c Bank%u Addr 0x%02x: %u us, EC slow (no SMI)",
+  L"Slow %c Bank%u Addr 0x%02x: %u us (no SMI count on this CPU)",
+};
+
+STATIC CONST CHAR16 *mLogSevName[] = { L"info", L"warn", L"error" };
+
+STATIC LOG_REC mLog[LOG_RING_SIZE];
+STATIC UINT32  mLogSeq;           // records ever logged; next Seq
+STATIC UINT32  mLogSinkSeq;       // first record not yet sent to the sink / console
+STATIC UINT32  mLogDropped;       // overwritten before the sink saw them
+STATIC OUT_BUF mLogOut;           // -l file sink (Fh NULL: none)
+
+STATIC
+VOID
+LogEvent (
+  IN LOG_SEV  Sev,
+  IN LOG_CODE Code,
+  IN UINT64   A0,
+  IN UINT64   A1,
+  IN UINT64   A2,
+  IN UINT64   A3,
+  IN UINT64   A4
+  )
+{
+  LOG_REC *R = &mLog[mLogSeq % LOG_RING_SIZE];
+
+  R->TimeUs = NowUs();
+  R->Seq    = mLogSeq++;
+  R->Sev    = (UINT8)Sev;
+  R->Code   = (UINT8)Code;
+  R->Arg[0] = A0;
+  R->Arg[1] = A1;
+  R->Arg[2] = A2;
+  R->Arg[3] = A3;
+  R->Arg[4] = A4;
+}
+
+#define LOG0(s, c)                LogEvent((s), (c), 0, 0, 0, 0, 0)
+#define LOG1(s, c, a)             LogEvent((s), (c), (UINT64)(a), 0, 0, 0, 0)
+#define LOG2(s, c, a, b)          LogEvent((s), (c), (UINT64)(a), (UINT64)(b), 0, 0, 0)
+#define LOG4(s, c, a, b, d, e)    LogEvent((s), (c), (UINT64)(a), (UINT64)(b), (UINT64)(d), (UINT64)(e), 0)
+#define LOG5(s, c, a, b, d, e, f) LogEvent((s), (c), (UINT64)(a), (UINT64)(b), (UINT64)(d), (UINT64)(e), (UINT64)(f))
+
+STATIC
+VOID
+LogFormat (
+  IN  CONST LOG_REC *R,
+  OUT CHAR16        *Text,
+  IN  UINTN         Size
+  )
+{
+  UnicodeSPrint(Text, Size, mLogFmt[R->Code],
+                (UINTN)R->Arg[0], (UINTN)R->Arg[1], (UINTN)R->Arg[2], (UINTN)R->Arg[3], (UINTN)R->Arg[4]);
+}
+
+// Oldest record still in the ring with Seq >= From
+STATIC
+UINT32
+LogFirstKept (
+  IN UINT32 From
+  )
+{
+  UINT32 Oldest = (mLogSeq > LOG_RING_SIZE) ? mLogSeq - LOG_RING_SIZE : 0;
+  return (From < Oldest) ? Oldest : From;
+}
+
+// Records not yet sent, in order; returns the first one still in the ring
+STATIC
+UINT32
+LogTakePending (
+  VOID
+  )
+{
+  UINT32 First = LogFirstKept(mLogSinkSeq);
+
+  mLogDropped += First - mLogSinkSeq;
+  mLogSinkSeq  = mLogSeq;
+  return First;
+}
+
+// -l file sink: write pending records once LOG_SINK_BATCH have piled up
+// (Force: any number)
+STATIC
+VOID
+LogSinkFlush (
+  IN BOOLEAN Force
+  )
+{
+  CHAR16 Text[LOG_TEXT_MAX];
+  CHAR8  Line[LOG_TEXT_MAX + 48];
+  UINT32 End = mLogSeq;
+
+  if (mLogOut.Fh == NULL || (!Force && mLogSeq - mLogSinkSeq < LOG_SINK_BATCH)) return;
+
+  for (UINT32 s = LogTakePending(); s < End; s++) {
+    CONST LOG_REC *R = &mLog[s % LOG_RING_SIZE];
+    UINT32        Us;
+    UINT64        Sec = DivU64x32Remainder(R->TimeUs - mStartUs, 1000000, &Us);
+
+    LogFormat(R, Text, sizeof(Text));
+    AsciiSPrint(Line, sizeof(Line), "%lu.%06u %-5S %S\n", Sec, Us, mLogSevName[R->Sev], Text);
+    OutRaw(&mLogOut, Line);
+  }
+  OutFlush(&mLogOut);
+}
+
+// End of a CLI command: pending records go to the sink, or to the console
+// (JSON "log" records with -j)
+STATIC
+VOID
+LogDrain (
+  VOID
+  )
+{
+  CHAR16 Text[LOG_TEXT_MAX];
+  UINT32 End = mLogSeq;
+
+  if (mLogOut.Fh != NULL) {
+    LogSinkFlush(TRUE);
+    return;
+  }
+
+  for (UINT32 s = LogTakePending(); s < End; s++) {
+    CONST LOG_REC *R = &mLog[s % LOG_RING_SIZE];
+
+    LogFormat(R, Text, sizeof(Text));
+    if (mJson) {
+      JsonBegin("log");
+      JsonKeyS("sev", mLogSevName[R->Sev]);
+      JsonKeyU("code", R->Code);
+      JsonKeyS("text", Text);
+      JsonEnd();
+    } else {
+      Print(L"[%s] %s\n", mLogSevName[R->Sev], Text);
+    }
+  }
+}
+
+// Last LOG_PANE_LINES records, colored by severity
+#ifndef EEPROMEC_CLI_ONLY
+STATIC
+VOID
+LogRenderPane (
+  VOID
+  )
+{
+  CHAR16 Text[LOG_TEXT_MAX];
+  UINT32 First = LogFirstKept((mLogSeq > LOG_PANE_LINES) ? mLogSeq - LOG_PANE_LINES : 0);
+
+  for (UINT32 s = First; s < mLogSeq; s++) {
+    CONST LOG_REC *R = &mLog[s % LOG_RING_SIZE];
+
+    LogFormat(R, Text, sizeof(Text));
+    if (R->Sev == LOG_ERROR)     SetAttr(EFI_TEXT_ATTR(EFI_LIGHTRED, EFI_BLACK));
+    else if (R->Sev == LOG_WARN) SetAttr(EFI_TEXT_ATTR(EFI_YELLOW, EFI_BLACK));
+    Print(L"%s\n", Text);
+    AttrDefault();
+  }
+}
+#endif // EEPROMEC_CLI_ONLY
 
 // =======================================================
 //                PORT I/O backend (60/64, 62/66)
 // =======================================================
 
+// 50 us polls spent waiting for OBF / the Index mailbox since the scheduler
+// last cleared it; a slow answer marks the byte suspect in vote mode
+STATIC UINT32 mWaitPolls;
+
 STATIC
 VOID
 GetPortPair (
@@ -199,6 +936,7 @@ PortWaitObfSet (
 {
   while (TimeoutUs > 0) {
     if ((PortReadStatus() & EC_STS_OBF) != 0) return EFI_SUCCESS;
+    mWaitPolls++;
     gBS->Stall(50);
     TimeoutUs = (TimeoutUs > 50) ? (TimeoutUs - 50) : 0;
   }
@@ -326,23 +1064,23 @@ IndexWaitCtl (
 
     if ((Cur & Mask) == Target) return EFI_SUCCESS;
 
+    mWaitPolls++;
     gBS->Stall(50);
     TimeoutUs = (TimeoutUs > 50) ? (TimeoutUs - 50) : 0;
   }
 
-  // Debug on timeout
-  Print(L"\n[IndexWait Timeout] Base=0x%04x Off(H/L/D)=(0x%02x/0x%02x/0x%02x)\n",
-        mEc.IndexIoBase, mEc.OffIndexHigh, mEc.OffIndexLow, mEc.OffData);
-  Print(L"  CtlAddr=0x%04x Cur=0x%02x Mask=0x%02x Target=0x%02x\n",
-        mEc.CmdCntl, Cur, Mask, Target);
+  // Debug on timeout (logged, shown in the log pane / sink)
+  LogEvent(LOG_ERROR, LOG_INDEX_TIMEOUT, mEc.CmdCntl, Cur, Mask, Target, mEc.IndexIoBase);
 
   return EFI_TIMEOUT;
 }
 
-// Fixed sequence: Fill buffers -> Set Start -> Wait Done -> Clear Processing
+// Mailbox start phase: Fill buffers -> Set Start. The EC works on its own
+// from here; IndexMailboxPoll completes the command, so a caller can drive
+// another EC meanwhile (see "Multiple ECs").
 STATIC
 EFI_STATUS
-IndexExecEepromCmd (
+IndexMailboxStart (
   IN UINT8 Cmd,
   IN UINT8 AddrOrBank,
   IN UINT8 WriteData,
@@ -374,20 +1112,210 @@ IndexExecEepromCmd (
 
   // 4) Trigger: set Start|Processing
   IndexIoWrite8(mEc.CmdCntl, (UINT8)(CMD_CNTL_PROCESSING | CMD_CNTL_START));
+  return EFI_SUCCESS;
+}
 
-  // 5) Wait done: Start bit becomes 0
-  Status = IndexWaitCtl(CMD_CNTL_START, 0, 500000);
-  if (EFI_ERROR(Status)) return Status;
+// Mailbox poll phase: one look at Start, EFI_NOT_READY while it is set
+STATIC
+EFI_STATUS
+IndexMailboxPoll (
+  VOID
+  )
+{
+  // 5) Done: Start bit becomes 0
+  if ((IndexIoRead8(mEc.CmdCntl) & CMD_CNTL_START) != 0) return EFI_NOT_READY;
 
   // 6) Unlock: clear Processing
   IndexIoWrite8(mEc.CmdCntl, 0);
-
   return EFI_SUCCESS;
 }
 
-// =======================================================
-//             Unified EEPROM operations (bank/read/write)
-// =======================================================
+// Fixed sequence: Fill buffers -> Set Start -> Wait Done -> Clear Processing
+STATIC
+EFI_STATUS
+IndexExecEepromCmd (
+  IN UINT8 Cmd,
+  IN UINT8 AddrOrBank,
+  IN UINT8 WriteData,
+  IN BOOLEAN IsWrite
+  )
+{
+  EFI_STATUS Status;
+
+  Status = IndexMailboxStart(Cmd, AddrOrBank, WriteData, IsWrite);
+  if (EFI_ERROR(Status)) return Status;
+
+  Status = IndexWaitCtl(CMD_CNTL_START, 0, 500000);
+  if (EFI_ERROR(Status)) return Status;
+
+  IndexIoWrite8(mEc.CmdCntl, 0);
+  return EFI_SUCCESS;
+}
+
+// Page write: same handshake, Count bytes staged in the mailbox
+STATIC
+EFI_STATUS
+IndexExecEepromPageWrite (
+  IN UINT8       Addr,
+  IN CONST UINT8 *Data,
+  IN UINT8       Count
+  )
+{
+  EFI_STATUS Status;
+
+  Status = IndexWaitCtl(CMD_CNTL_PROCESSING, 0, 200000);
+  if (EFI_ERROR(Status)) return Status;
+
+  IndexIoWrite8(mEc.CmdCntl, CMD_CNTL_PROCESSING);
+
+  IndexIoWrite8(mEc.DataOfCmdBuffer, mEc.PageWriteCmd);
+  IndexIoWrite8(mEc.WriteAddrBuf, Addr);
+  IndexIoWrite8(mEc.PageLenBuf, Count);
+  for (UINTN i = 0; i < Count; i++) {
+    IndexIoWrite8((UINT16)(mEc.PageDataBuf + i), Data[i]);
+  }
+
+  IndexIoWrite8(mEc.CmdCntl, (UINT8)(CMD_CNTL_PROCESSING | CMD_CNTL_START));
+
+  // One internal write cycle (typ. 5 ms) plus the EC's own overhead
+  Status = IndexWaitCtl(CMD_CNTL_START, 0, 500000);
+  if (EFI_ERROR(Status)) return Status;
+
+  IndexIoWrite8(mEc.CmdCntl, 0);
+  return EFI_SUCCESS;
+}
+
+// =======================================================
+//        Chipset I/O decode (PCH LPC/eSPI bridge)
+// =======================================================
+//
+// An I/O cycle the PCH doesn't forward to LPC/eSPI never reaches the EC:
+// the read floats to 0xFF and every wait runs into its timeout. The bridge
+// at 0:1F.0 says what is forwarded: fixed enables for the legacy ports
+// (IOE) and four generic ranges (LGIR1-4). Read them once at startup and
+// fail or skip backends outside them at once instead of timing out.
+// Non-Intel bridges are not decoded here: everything counts as routed.
+
+#define LPC_BUS                 0
+#define LPC_DEV                 0x1F
+#define LPC_FUNC                0
+#define LPC_REG_IOD             0x80      // COM/LPT/FDD ranges
+#define LPC_REG_IOE             0x82      // fixed decode enables
+#define LPC_REG_GEN1            0x84      // LGIR1, 4 consecutive dwords
+#define LPC_GEN_COUNT           4
+
+#define LPC_IOE_KE              (1u << 10)   // 60/64
+#define LPC_IOE_MC              (1u << 11)   // 62/66
+#define LPC_IOE_CNF1            (1u << 12)   // 2E/2F
+#define LPC_IOE_CNF2            (1u << 13)   // 4E/4F
+
+#define LPC_GEN_EN              (1u << 0)
+#define LPC_GEN_BASE(r)         ((UINT16)((r) & 0xFFFC))         // bits 15:2
+#define LPC_GEN_MASK(r)         ((UINT16)(((r) >> 16) & 0xFC))   // bits 23:18 -> address bits 7:2
+
+STATIC struct {
+  BOOLEAN Known;                  // Intel LPC/eSPI bridge found and read
+  BOOLEAN Check;                  // -decode off: trust the user, probe anyway
+  UINT16  Vid;
+  UINT16  Did;
+  UINT16  Iod;
+  UINT16  Ioe;
+  UINT32  Gen[LPC_GEN_COUNT];
+} mDecode = { FALSE, TRUE };
+
+STATIC
+VOID
+DecodeInit (
+  VOID
+  )
+{
+  UINTN Dev = PCI_LIB_ADDRESS(LPC_BUS, LPC_DEV, LPC_FUNC, 0);
+
+  mDecode.Vid   = PciRead16(Dev + 0x00);
+  mDecode.Did   = PciRead16(Dev + 0x02);
+  // Class 06 (bridge), subclass 01 (ISA): the LPC / eSPI controller
+  mDecode.Known = (BOOLEAN)(mDecode.Vid == 0x8086 &&
+                            PciRead8(Dev + 0x0B) == 0x06 && PciRead8(Dev + 0x0A) == 0x01);
+  if (!mDecode.Known) return;
+
+  mDecode.Iod = PciRead16(Dev + LPC_REG_IOD);
+  mDecode.Ioe = PciRead16(Dev + LPC_REG_IOE);
+  for (UINTN i = 0; i < LPC_GEN_COUNT; i++) {
+    mDecode.Gen[i] = PciRead32(Dev + LPC_REG_GEN1 + i * 4);
+  }
+}
+
+// TRUE if I/O port Port is forwarded to LPC/eSPI (or we can't tell)
+STATIC
+BOOLEAN
+DecodeCovers (
+  IN UINT16 Port
+  )
+{
+  if (!mDecode.Known) return TRUE;
+
+  switch (Port) {
+  case 0x60: case 0x64: if ((mDecode.Ioe & LPC_IOE_KE) != 0) return TRUE;   break;
+  case 0x62: case 0x66: if ((mDecode.Ioe & LPC_IOE_MC) != 0) return TRUE;   break;
+  case 0x2E: case 0x2F: if ((mDecode.Ioe & LPC_IOE_CNF1) != 0) return TRUE; break;
+  case 0x4E: case 0x4F: if ((mDecode.Ioe & LPC_IOE_CNF2) != 0) return TRUE; break;
+  default: break;
+  }
+
+  for (UINTN i = 0; i < LPC_GEN_COUNT; i++) {
+    UINT32 r = mDecode.Gen[i];
+    if ((r & LPC_GEN_EN) != 0 &&
+        (UINT16)(Port & ~(LPC_GEN_MASK(r) | 3)) == LPC_GEN_BASE(r)) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+// TRUE if every port the mEc backend uses reaches the EC
+STATIC
+BOOLEAN
+DecodeBackendRouted (
+  VOID
+  )
+{
+  UINT16 Lo, Hi;
+
+  if (!mDecode.Check) return TRUE;
+
+  if (mEc.AccessType == ACCESS_PORTIO) {
+    GetPortPair(&Lo, &Hi);
+    return (BOOLEAN)(DecodeCovers(Lo) && DecodeCovers(Hi));
+  }
+
+  Lo = (UINT16)(mEc.IndexIoBase + MIN(mEc.OffData, MIN(mEc.OffIndexHigh, mEc.OffIndexLow)));
+  Hi = (UINT16)(mEc.IndexIoBase + MAX(mEc.OffData, MAX(mEc.OffIndexHigh, mEc.OffIndexLow)));
+  for (UINTN p = Lo; p <= Hi; p++) {
+    if (!DecodeCovers((UINT16)p)) return FALSE;
+  }
+  return TRUE;
+}
+
+// First I/O port of the mEc backend, for log records
+STATIC
+UINT16
+DecodeBackendPort (
+  VOID
+  )
+{
+  UINT16 DataPort, CmdPort;
+
+  if (mEc.AccessType != ACCESS_PORTIO) return mEc.IndexIoBase;
+  GetPortPair(&DataPort, &CmdPort);
+  return DataPort;
+}
+
+// =======================================================
+//             Unified EEPROM operations (bank/read/write)
+// =======================================================
+
+// Chip identification further down; first called from here
+STATIC VOID ChipSelectProfile (VOID);
 
 STATIC
 EFI_STATUS
@@ -395,16 +1323,20 @@ EcSetBank (
   IN UINT8 Bank
   )
 {
+  EFI_STATUS Status;
+
   if (Bank > EEPROM_BANK_MAX) return EFI_INVALID_PARAMETER;
 
   if (mEc.AccessType == ACCESS_PORTIO) {
-    EFI_STATUS Status;
     Status = PortWriteCmd(EC_CMD_EEPROM_BANK_NUM);
-    if (EFI_ERROR(Status)) return Status;
-    return PortWriteData(Bank);
+    if (!EFI_ERROR(Status)) Status = PortWriteData(Bank);
+  } else {
+    Status = IndexExecEepromCmd(EC_CMD_EEPROM_BANK_NUM, Bank, 0, FALSE);
   }
 
-  return IndexExecEepromCmd(EC_CMD_EEPROM_BANK_NUM, Bank, 0, FALSE);
+  // Remember what the EC has selected so the prefetcher can skip redundant switches
+  mEcBankSel = EFI_ERROR(Status) ? -1 : (INTN)Bank;
+  return Status;
 }
 
 STATIC
@@ -434,6 +1366,61 @@ EcReadEeprom8 (
   return EFI_SUCCESS;
 }
 
+// Count bytes inside one EEPROM page, one internal write cycle
+STATIC
+EFI_STATUS
+EcWriteEepromPage (
+  IN UINT8       Addr,
+  IN CONST UINT8 *Data,
+  IN UINT8       Count
+  )
+{
+  EFI_STATUS Status;
+
+  if (mEc.PageWriteCmd == 0 || Count == 0 || Count > mEc.PageSize) return EFI_UNSUPPORTED;
+
+  if (mEc.AccessType != ACCESS_PORTIO) return IndexExecEepromPageWrite(Addr, Data, Count);
+
+  Status = PortWriteCmd(mEc.PageWriteCmd);
+  if (EFI_ERROR(Status)) return Status;
+  Status = PortWriteData(Addr);
+  if (EFI_ERROR(Status)) return Status;
+  Status = PortWriteData(Count);
+  for (UINTN i = 0; i < Count && !EFI_ERROR(Status); i++) {
+    Status = PortWriteData(Data[i]);
+  }
+  return Status;
+}
+
+// Raw EC RAM byte (not EEPROM): Index I/O reads it directly, PortIO uses ACPI RD_EC
+STATIC
+EFI_STATUS
+EcRamRead8 (
+  IN  UINT16 Addr,
+  OUT UINT8  *Val
+  )
+{
+  EFI_STATUS Status;
+
+  if (!Val) return EFI_INVALID_PARAMETER;
+  ChipSelectProfile();
+  // An undecoded Index window reads 0xFF without any timeout: don't show that as data
+  if (!DecodeBackendRouted()) return EFI_NO_MAPPING;
+
+  if (mEc.AccessType != ACCESS_PORTIO) {
+    *Val = IndexIoRead8(Addr);
+    return EFI_SUCCESS;
+  }
+
+  if (mEc.PortMode != PORTMODE_ACPI_62_66 || Addr > 0xFF) return EFI_UNSUPPORTED;
+
+  Status = PortWriteCmd(EC_CMD_ACPI_READ);
+  if (EFI_ERROR(Status)) return Status;
+  Status = PortWriteData((UINT8)Addr);
+  if (EFI_ERROR(Status)) return Status;
+  return PortReadData(Val);
+}
+
 STATIC
 EFI_STATUS
 EcWriteEeprom8 (
@@ -454,498 +1441,6034 @@ EcWriteEeprom8 (
 }
 
 // =======================================================
-//                       UI helpers
+//          Bank cache + EC request scheduler
 // =======================================================
+//
+// Every EEPROM transaction goes through one queue so that interactive
+// reads/writes, verification and background producers (prefetch, ...)
+// can share the single EC mailbox:
+//   - priority classes: USER_WRITE > USER_READ > WATCH > VERIFY > PREFETCH
+//   - one byte transaction (or one bank switch) per EcSchedStep(), the
+//     next request is re-picked after every byte -> byte-level preemption
+//   - same class: prefer the bank the EC already has selected, then FIFO
+//   - a request that waited EC_SCHED_AGE_STEP transactions moves up one class
+//   - a read fully covered by a pending read of the same bank is merged
+//   - reads land in mCache; callers copy out of the cache when done
+
+#define EC_REQ_MAX              16
+#define EC_SCHED_AGE_STEP       64
+
+typedef enum {
+  EC_PRIO_USER_WRITE = 0,
+  EC_PRIO_USER_READ,
+  EC_PRIO_WATCH,          // reserved for watch polling
+  EC_PRIO_VERIFY,
+  EC_PRIO_PREFETCH,
+  EC_PRIO_COUNT
+} EC_PRIO;
+
+#define EC_REQ_SKIP_CACHED      (1u << 0)   // read: don't refetch bytes already valid in mCache
+#define EC_REQ_FORCE_BANK       (1u << 1)   // reselect the bank even if the EC should still have it
+
+typedef struct {
+  BOOLEAN    InUse;
+  BOOLEAN    Done;
+  BOOLEAN    IsWrite;
+  BOOLEAN    NeedBank;   // EC_REQ_FORCE_BANK: (re)select the bank before the first byte
+  UINT8      Prio;       // EC_PRIO
+  UINT8      Flags;      // EC_REQ_*
+  UINT8      Bank;
+  UINT8      Refs;       // submitters sharing this request (merged reads)
+  UINT16     Start;
+  UINT16     End;        // exclusive, <= 256
+  UINT16     Next;       // next offset to transfer
+  UINT32     Waited;     // transactions dispatched while this one was pending
+  UINT32     Seq;
+  EFI_STATUS Status;
+  UINT8      Data[256];  // write payload, indexed by offset
+} EC_REQ;
+
+typedef struct {
+  UINT32 Xfer[EC_PRIO_COUNT];   // byte transactions per class
+  UINT32 BankSwitches;
+  UINT32 Merged;
+  UINT32 Promoted;              // dispatches that only won because of aging
+  UINT32 Errors;
+  UINT32 WriteCycles;           // EEPROM internal write cycles (byte or page)
+  UINT32 PageWrites;
+  UINT32 PageFallbacks;         // page writes given up on: byte writes from then on
+  UINT32 PageRetries;           // transient page-write failures, retried
+  UINT32 Reads;                 // EEPROM byte reads (first read of each byte)
+  UINT32 Voted;                 // vote mode: suspect bytes decided by majority
+  UINT32 VoteReads;             // extra reads spent on retries and votes
+  UINT32 VoteFixed;             // majority differed from the first read
+  UINT32 VoteUndecided;         // no majority, read failed
+} EC_SCHED_STATS;
+
+STATIC EC_REQ         mReq[EC_REQ_MAX];
+STATIC UINT32         mReqSeq      = 0;
+STATIC EC_SCHED_STATS mSched;
+
+STATIC struct {
+  UINTN  Req;              // outstanding scrub read, EC_REQ_MAX if none
+  UINTN  Pos;              // rotating position over (bank * 256 + offset)
+  UINT8  Bank;
+  UINT8  Off;
+  UINT8  Expect;           // cached value when the reread was issued
+  UINT32 Gen;              // mWriteGen when the reread was issued
+  UINT64 LastUs;
+  UINT32 Checked;
+  UINT32 Mismatch;
+} mScrub = { EC_REQ_MAX };
+STATIC UINTN          mPrefetchReq = EC_REQ_MAX;   // outstanding prefetch request
+STATIC UINT32         mWriteGen    = 0;            // bumped by every EEPROM byte write
+STATIC BOOLEAN        mVote        = FALSE;        // -vote / V: majority-read suspect bytes
 
 STATIC
 BOOLEAN
-IsPrintableAscii (
-  IN UINT8 b
+CacheIsValid (
+  IN UINT8 Bank,
+  IN UINT8 Off
   )
 {
-  return (BOOLEAN)(b >= 0x20 && b <= 0x7E);
+  return (BOOLEAN)((mCacheValid[Bank][Off >> 3] & (1u << (Off & 7))) != 0);
 }
 
 STATIC
-UINT16
-ReadU16LE (
-  IN UINTN Off
+VOID
+CacheSet (
+  IN UINT8 Bank,
+  IN UINT8 Off,
+  IN UINT8 Val
   )
 {
-  return (UINT16)(mDump[Off] | ((UINT16)mDump[Off + 1] << 8));
+  mCache[Bank][Off] = Val;
+  mCacheValid[Bank][Off >> 3] |= (UINT8)(1u << (Off & 7));
 }
 
 STATIC
-UINT32
-ReadU32LE (
-  IN UINTN Off
+BOOLEAN
+CacheBankComplete (
+  IN UINT8 Bank
   )
 {
-  return (UINT32)(mDump[Off] |
-                 ((UINT32)mDump[Off + 1] << 8) |
-                 ((UINT32)mDump[Off + 2] << 16) |
-                 ((UINT32)mDump[Off + 3] << 24));
+  for (UINTN i = 0; i < sizeof(mCacheValid[Bank]); i++) {
+    if (mCacheValid[Bank][i] != 0xFF) return FALSE;
+  }
+  return TRUE;
 }
 
+#ifndef EEPROMEC_CLI_ONLY
 STATIC
-VOID
-AlignCursorToMode (
-  VOID
+BOOLEAN
+ExtModIsSet (
+  IN UINT8 Bank,
+  IN UINTN Off,
+  IN UINTN Len
   )
 {
-  UINT8 col = (UINT8)(mCursor % COLS);
-  UINT8 row = (UINT8)(mCursor / COLS);
-
-  if (mDispMode == DISP_WORD) {
-    col = (UINT8)(col & ~1u);
-  } else if (mDispMode == DISP_DWORD) {
-    col = (UINT8)(col & ~3u);
+  for (UINTN i = Off; i < Off + Len && i < 256; i++) {
+    if ((mExtMod[Bank][i >> 3] & (1u << (i & 7))) != 0) return TRUE;
   }
-  mCursor = (UINT8)(row * COLS + col);
+  return FALSE;
 }
+#endif // EEPROMEC_CLI_ONLY
 
+// Backend switch: queued requests and the EC's bank selection don't carry
+// over. Cached EEPROM bytes do, every backend reaches the same part (the
+// UI validates them with a few sampled reads, see RefreshStart).
 STATIC
 VOID
-CycleDispMode (
+EcBackendReset (
   VOID
   )
 {
-  if (mDispMode == DISP_BYTE) mDispMode = DISP_WORD;
-  else if (mDispMode == DISP_WORD) mDispMode = DISP_DWORD;
-  else mDispMode = DISP_BYTE;
-
-  AlignCursorToMode();
+  SetMem(mReq, sizeof(mReq), 0);
+#ifndef EEPROMEC_CLI_ONLY
+  SetMem(mRamPages, sizeof(mRamPages), 0);
+  mRamReadAheadHold = FALSE;
+#endif // EEPROMEC_CLI_ONLY
+  mPrefetchReq  = EC_REQ_MAX;
+  mScrub.Req    = EC_REQ_MAX;
+  mEcBankSel    = -1;
+  mPrefetchHold = FALSE;
+  mPageWriteOk  = FALSE;
+  mPageFailRun  = 0;
 }
 
+// Nothing cached or queued so far can be trusted
 STATIC
 VOID
-MoveCursor (
-  IN INTN dRow,
-  IN INTN dCol
+CacheInvalidateAll (
+  VOID
   )
 {
-  INTN row = (INTN)(mCursor / COLS);
-  INTN col = (INTN)(mCursor % COLS);
+  SetMem(mCacheValid, sizeof(mCacheValid), 0);
+  SetMem(mExtMod, sizeof(mExtMod), 0);
+  EcBackendReset();
+}
 
-  row += dRow;
+STATIC
+BOOLEAN
+EcReqIsPending (
+  IN CONST EC_REQ *R
+  )
+{
+  return (BOOLEAN)(R->InUse && !R->Done);
+}
 
-  if (dCol != 0) {
-    INTN step = (INTN)mDispMode; // 1/2/4
-    col += dCol * step;
+// Any pending write to Bank overlapping [Start, End)?
+STATIC
+BOOLEAN
+EcReqWritePending (
+  IN UINT8 Bank,
+  IN UINTN Start,
+  IN UINTN End
+  )
+{
+  for (UINTN i = 0; i < EC_REQ_MAX; i++) {
+    CONST EC_REQ *W = &mReq[i];
+    if (!EcReqIsPending(W) || !W->IsWrite || W->Bank != Bank) continue;
+    if (Start < W->End && W->Next < End) return TRUE;
+  }
+  return FALSE;
+}
 
-    if (mDispMode == DISP_WORD) col &= ~1;
-    else if (mDispMode == DISP_DWORD) col &= ~3;
+// Submit a read/write of [Start, Start+Len) in Bank. Writes take Data[0..Len-1].
+STATIC
+EFI_STATUS
+EcReqSubmit (
+  IN  EC_PRIO     Prio,
+  IN  UINT8       Bank,
+  IN  UINT8       Start,
+  IN  UINTN       Len,
+  IN  BOOLEAN     IsWrite,
+  IN  CONST UINT8 *Data,   OPTIONAL
+  IN  UINT8       Flags,
+  OUT UINTN       *Handle
+  )
+{
+  EC_REQ *R;
+
+  if (Bank > EEPROM_BANK_MAX || Len == 0 || (UINTN)Start + Len > 256) return EFI_INVALID_PARAMETER;
+  if (IsWrite && !Data) return EFI_INVALID_PARAMETER;
+
+  // Merge a read into a pending read of the same bank that still covers it
+  // (never across a pending write: the older read would miss the new data)
+  if (!IsWrite && !EcReqWritePending(Bank, Start, (UINTN)Start + Len)) {
+    for (UINTN i = 0; i < EC_REQ_MAX; i++) {
+      R = &mReq[i];
+      if (!EcReqIsPending(R) || R->IsWrite || R->Bank != Bank) continue;
+      if (Start < R->Next || (UINTN)Start + Len > R->End) continue;
+
+      if (Prio < R->Prio) R->Prio = (UINT8)Prio;
+      R->Flags &= Flags;      // anyone asking for fresh data wins
+      R->Refs++;
+      mSched.Merged++;
+      *Handle = i;
+      return EFI_SUCCESS;
+    }
   }
 
-  if (row < 0) row = 0;
-  if (row >= (INTN)ROWS) row = (INTN)ROWS - 1;
-  if (col < 0) col = 0;
-  if (col >= (INTN)COLS) col = (INTN)COLS - 1;
+  for (UINTN i = 0; i < EC_REQ_MAX; i++) {
+    R = &mReq[i];
+    if (R->InUse) continue;
+
+    SetMem(R, sizeof(*R), 0);
+    R->InUse    = TRUE;
+    R->IsWrite  = IsWrite;
+    R->NeedBank = (BOOLEAN)((Flags & EC_REQ_FORCE_BANK) != 0);
+    R->Prio     = (UINT8)Prio;
+    R->Flags    = Flags;
+    R->Bank     = Bank;
+    R->Refs     = 1;
+    R->Start    = Start;
+    R->End      = (UINT16)(Start + Len);
+    R->Next     = Start;
+    R->Seq      = mReqSeq++;
+    R->Status   = EFI_SUCCESS;
+    if (IsWrite) CopyMem(&R->Data[Start], Data, Len);
+
+    *Handle = i;
+    return EFI_SUCCESS;
+  }
 
-  mCursor = (UINT8)(row * COLS + col);
+  return EFI_OUT_OF_RESOURCES;
 }
 
 STATIC
-CONST CHAR16*
-AccessName (
-  VOID
+VOID
+EcReqRelease (
+  IN UINTN Handle
   )
 {
-  switch (mEc.AccessType) {
-  case ACCESS_PORTIO:          return L"PortIO";
-  case ACCESS_INDEXIO_ENE:     return L"IndexIO-ENE";
-  case ACCESS_INDEXIO_NUVOTON: return L"IndexIO-Nuvoton";
-  case ACCESS_INDEXIO_ITE:     return L"IndexIO-ITE";
-  default:                     return L"Unknown";
+  EC_REQ *R = &mReq[Handle];
+
+  if (R->Refs > 0) R->Refs--;
+  if (R->Refs == 0) R->InUse = FALSE;
+}
+
+// Read-after-write hazard: an older pending write to the same byte goes first
+STATIC
+BOOLEAN
+EcReqBlocked (
+  IN CONST EC_REQ *R
+  )
+{
+  if (R->IsWrite) return FALSE;
+
+  for (UINTN i = 0; i < EC_REQ_MAX; i++) {
+    CONST EC_REQ *W = &mReq[i];
+    if (!EcReqIsPending(W) || !W->IsWrite || W->Bank != R->Bank) continue;
+    if (W->Seq < R->Seq && R->Next >= W->Next && R->Next < W->End) return TRUE;
   }
+  return FALSE;
 }
 
 STATIC
-VOID
-GetPortPairText (
-  OUT CONST CHAR16 **Text
+UINTN
+EcReqEffectivePrio (
+  IN CONST EC_REQ *R
   )
 {
-  if (mEc.PortMode == PORTMODE_8042_60_64) *Text = L"60/64";
-  else *Text = L"62/66";
+  UINTN Boost = R->Waited / EC_SCHED_AGE_STEP;
+  return (Boost >= R->Prio) ? 0 : (R->Prio - Boost);
 }
 
+// Pick the next request to serve; EC_REQ_MAX if nothing is runnable
 STATIC
-VOID
-PrintHeader (
+UINTN
+EcSchedPick (
   VOID
   )
 {
-  CONST CHAR16 *ModeStr =
-    (mDispMode == DISP_BYTE) ? L"BYTE" :
-    (mDispMode == DISP_WORD) ? L"WORD" : L"DWORD";
+  UINTN Best = EC_REQ_MAX;
 
-  CONST CHAR16 *PortTxt = L"--";
-  GetPortPairText(&PortTxt);
-
-  PrintParenGreen(L"EEPROM/EC Tool");
-  Print(L" ");
-  PrintParenGreen(L"PortIO 60/64,62/66 + IndexIO ENE/Nuvoton/ITE");
-  Print(L"\n");
+  for (UINTN i = 0; i < EC_REQ_MAX; i++) {
+    CONST EC_REQ *R = &mReq[i];
+    CONST EC_REQ *B;
+    UINTN        Pr, Pb;
+    BOOLEAN      SameR, SameB;
 
-  PrintParenGreen(L"Access:");
-  Print(L"%s  ", AccessName());
+    if (!EcReqIsPending(R) || EcReqBlocked(R)) continue;
+    if (Best == EC_REQ_MAX) { Best = i; continue; }
 
-  PrintParenGreen(L"Port:");
-  if (mEc.AccessType == ACCESS_PORTIO) Print(L"%s  ", PortTxt);
-  else Print(L"--  ");
+    B  = &mReq[Best];
+    Pr = EcReqEffectivePrio(R);
+    Pb = EcReqEffectivePrio(B);
+    if (Pr != Pb) { if (Pr < Pb) Best = i; continue; }
 
-  PrintParenGreen(L"Bank:");
-  Print(L"%u  ", mBank);
+    SameR = (BOOLEAN)(mEcBankSel == (INTN)R->Bank);
+    SameB = (BOOLEAN)(mEcBankSel == (INTN)B->Bank);
+    if (SameR != SameB) { if (SameR) Best = i; continue; }
 
-  Print(L"Mode:%s\n", ModeStr);
+    if (R->Seq < B->Seq) Best = i;
+  }
 
-  Print(L"      ");
-  for (UINTN i = 0; i < COLS; i++) Print(L"%02x ", (UINTN)i);
-  Print(L"   ASCII\n");
+  return Best;
 }
 
 STATIC
 VOID
-PrintRow (
-  IN UINTN Row
+EcReqComplete (
+  IN EC_REQ     *R,
+  IN EFI_STATUS Status
   )
 {
-  UINTN base = Row * COLS;
+  R->Status = Status;
+  R->Done   = TRUE;
+  if (EFI_ERROR(Status)) {
+    mSched.Errors++;
+    mEcBankSel = -1;   // EC state unknown after a failed transaction
+  }
+}
+
+// ---------- Vote mode (flaky channels) ----------
+#define VOTE_SLOW_POLLS         10    // >= 500 us waiting for OBF / the mailbox: suspect
+#define VOTE_RETRIES            2     // timed-out reads retried before failing
+#define VOTE_READS_MAX          5
+
+// Vote mode: *Val was just read from Off of the selected Bank with Status.
+// Timed-out reads are retried. A byte that needed a retry, answered slowly
+// or differs from the cache is suspect: it is reread until one value holds
+// a majority (2/2, 2/3, 3/4, 3/5). Clean bytes cost nothing extra.
+STATIC
+EFI_STATUS
+EcReadVoted (
+  IN     UINT8      Bank,
+  IN     UINT8      Off,
+  IN     EFI_STATUS Status,
+  IN OUT UINT8      *Val
+  )
+{
+  UINT8   Sample[VOTE_READS_MAX];
+  UINTN   n;
+  BOOLEAN Suspect = (BOOLEAN)(mWaitPolls >= VOTE_SLOW_POLLS);
+
+  for (UINTN r = 0; EFI_ERROR(Status) && r < VOTE_RETRIES; r++) {
+    mSched.VoteReads++;
+    Suspect = TRUE;
+    Status  = EcReadEeprom8(Off, Val);
+  }
+  if (EFI_ERROR(Status)) return Status;
+  if (CacheIsValid(Bank, Off) && mCache[Bank][Off] != *Val) Suspect = TRUE;
+  if (!Suspect) return EFI_SUCCESS;
+
+  mSched.Voted++;
+  Sample[0] = *Val;
+  n         = 1;
+  for (UINTN Try = 1; Try < VOTE_READS_MAX; Try++) {
+    mSched.VoteReads++;
+    if (EFI_ERROR(EcReadEeprom8(Off, &Sample[n]))) continue;
+    n++;
+
+    for (UINTN i = 0; i < n; i++) {
+      UINTN Votes = 0;
+      for (UINTN j = 0; j < n; j++) Votes += (Sample[j] == Sample[i]) ? 1 : 0;
+      if (Votes >= 2 && Votes * 2 > n) {
+        if (Sample[i] != *Val) mSched.VoteFixed++;
+        *Val = Sample[i];
+        return EFI_SUCCESS;
+      }
+    }
+  }
+
+  mSched.VoteUndecided++;
+  return EFI_DEVICE_ERROR;
+}
+
+// ---------- Transaction latency (host SMI vs slow EC) ----------
+//
+// Every dispatched transaction is timed with the TSC and bracketed by
+// MSR_SMI_COUNT. If the count moved, the CPU spent part of the interval in
+// SMM and the time says nothing about the EC. Latencies go into log2
+// histograms split by cause, outliers are logged with the attribution, and
+// a slow answer with an SMI in it doesn't make a byte suspect in vote mode.
+// Timeout tuning and vendor reports should only look at the "EC" rows.
+// Nothing is sampled until LatArm (-lat on, or the D screen opened).
+
+#define MSR_SMI_COUNT           0x34
+#define LAT_BUCKETS             14        // < 8 us, < 16 us, ... < 32 ms, >= 32 ms
+#define LAT_OUTLIER_US          1000      // reads and bank switches
+#define LAT_OUTLIER_WRITE_US    20000     // writes include an internal write cycle
+
+typedef enum {
+  LAT_OP_READ = 0,
+  LAT_OP_WRITE,
+  LAT_OP_BANK,
+  LAT_OP_COUNT
+} LAT_OP;
+
+typedef enum {
+  LAT_EC = 0,                     // no SMI during the transaction (or no MSR)
+  LAT_SMI,
+  LAT_CAUSE_COUNT
+} LAT_CAUSE;
+
+STATIC struct {
+  BOOLEAN SmiMsr;                 // MSR_SMI_COUNT readable on this CPU
+  BOOLEAN Armed;                  // recording (and reading the MSR) since LatArm
+  UINT32  Smis;                   // SMIs that landed inside transactions
+  UINT32  Hist[LAT_OP_COUNT][LAT_CAUSE_COUNT][LAT_BUCKETS];
+  UINT32  Outliers[LAT_OP_COUNT][LAT_CAUSE_COUNT];
+  UINT64  MaxUs[LAT_OP_COUNT][LAT_CAUSE_COUNT];
+} mLat;
+
+STATIC BOOLEAN mLatReport;        // -lat on: histograms at the end of a command
+
+STATIC CONST CHAR16 *mLatOpName[LAT_OP_COUNT]       = { L"Read", L"Write", L"Bank" };
+STATIC CONST CHAR16 *mLatCauseName[LAT_CAUSE_COUNT] = { L"EC", L"SMI" };
+
+// MSR_SMI_COUNT exists on Intel cores from Nehalem on; reading it anywhere
+// else faults (#GP in firmware: a hang), so attribution stays off on other
+// CPUs and under a hypervisor, which may not emulate it
+STATIC
+VOID
+LatInit (
+  VOID
+  )
+{
+  UINT32 Eax, Ebx, Ecx, Edx;
+  UINT32 Family, Model;
+
+  AsmCpuid(0, &Eax, &Ebx, &Ecx, &Edx);
+  if (Ebx != 0x756E6547 || Edx != 0x49656E69 || Ecx != 0x6C65746E) return;   // "GenuineIntel"
+
+  AsmCpuid(1, &Eax, NULL, &Ecx, NULL);
+  if ((Ecx & (1u << 31)) != 0) return;                                        // hypervisor present
+  Family = (Eax >> 8) & 0xF;
+  Model  = ((Eax >> 4) & 0xF) | ((Eax >> 12) & 0xF0);
+  if (Family != 6 || Model < 0x1A) return;
+  if (Model == 0x1D) return;                                                  // Dunnington (Penryn core)
+  if (Model == 0x1C || Model == 0x26 || Model == 0x27 || Model == 0x35 || Model == 0x36) return;   // Bonnell/Saltwell Atom
+
+  mLat.SmiMsr = TRUE;
+}
+
+// Start recording; histograms cover transactions from here on
+STATIC
+VOID
+LatArm (
+  VOID
+  )
+{
+  mLat.Armed = TRUE;
+}
+
+STATIC
+UINT32
+LatSmiCount (
+  VOID
+  )
+{
+  return (mLat.Armed && mLat.SmiMsr) ? (UINT32)AsmReadMsr64(MSR_SMI_COUNT) : 0;
+}
+
+// One transaction started at Tsc0 with SMI count Smi0 just finished.
+// Returns TRUE if an SMI hit it.
+STATIC
+BOOLEAN
+LatRecord (
+  IN LAT_OP Op,
+  IN UINT8  Bank,
+  IN UINT8  Off,
+  IN UINT64 Tsc0,
+  IN UINT32 Smi0
+  )
+{
+  UINT64    Us;
+  UINT32    Smi;
+  LAT_CAUSE Cause;
+  UINTN     b = 0;
+
+  if (!mLat.Armed) return FALSE;
+  Us    = DivU64x64Remainder(AsmReadTsc() - Tsc0, mTscPerUs, NULL);
+  Smi   = LatSmiCount() - Smi0;
+  Cause = (Smi != 0) ? LAT_SMI : LAT_EC;
+
+  while (b + 1 < LAT_BUCKETS && Us >= LShiftU64(8, b)) b++;
+  mLat.Hist[Op][Cause][b]++;
+  mLat.Smis += Smi;
+  if (Us > mLat.MaxUs[Op][Cause]) mLat.MaxUs[Op][Cause] = Us;
+
+  if (Us >= ((Op == LAT_OP_WRITE) ? LAT_OUTLIER_WRITE_US : LAT_OUTLIER_US)) {
+    mLat.Outliers[Op][Cause]++;
+    if (Cause == LAT_SMI) {
+      LOG5(LOG_WARN, LOG_LAT_HOST_SMI, mLatOpName[Op][0], Bank, Off, Us, Smi);
+    } else {
+      LOG4(LOG_WARN, mLat.SmiMsr ? LOG_LAT_EC_SLOW : LOG_LAT_UNATTRIBUTED,
+           mLatOpName[Op][0], Bank, Off, Us);
+    }
+  }
+  return (BOOLEAN)(Cause == LAT_SMI);
+}
+
+// Histogram table (D screen, -lat on); 79 columns
+STATIC
+VOID
+LatPrint (
+  VOID
+  )
+{
+  STATIC CONST CHAR16 *Bound[LAT_BUCKETS] = {
+    L"<8", L"<16", L"<32", L"<64", L"<128", L"<256", L"<512",
+    L"<1m", L"<2m", L"<4m", L"<8m", L"<16m", L"<32m", L">32m"
+  };
+
+  if (mLat.SmiMsr) Print(L"  SMI count (MSR 0x34): %u SMIs inside transactions\n", (UINTN)mLat.Smis);
+  else Print(L"  SMI count (MSR 0x34) not available (CPU or hypervisor): nothing attributed to SMI\n");
+
+  Print(L"  us       ");
+  for (UINTN b = 0; b < LAT_BUCKETS; b++) Print(L"%5s", Bound[b]);
+  Print(L"\n");
+  for (UINTN o = 0; o < LAT_OP_COUNT; o++) {
+    for (UINTN c = 0; c < LAT_CAUSE_COUNT; c++) {
+      Print(L"  %-5s %-3s", mLatOpName[o], mLatCauseName[c]);
+      for (UINTN b = 0; b < LAT_BUCKETS; b++) Print(L"%5u", (UINTN)mLat.Hist[o][c][b]);
+      Print(L"\n");
+    }
+  }
+  Print(L"  Outliers (>= %u us, writes >= %u us) EC/SMI:", (UINTN)LAT_OUTLIER_US, (UINTN)LAT_OUTLIER_WRITE_US);
+  for (UINTN o = 0; o < LAT_OP_COUNT; o++) {
+    Print(L" %s %u/%u", mLatOpName[o], (UINTN)mLat.Outliers[o][LAT_EC], (UINTN)mLat.Outliers[o][LAT_SMI]);
+  }
+  Print(L"\n");
+}
+
+// One "latency" event per op and cause that saw any transaction
+STATIC
+VOID
+LatJson (
+  VOID
+  )
+{
+  CHAR16 Hist[LAT_BUCKETS * 11];
+
+  for (UINTN o = 0; o < LAT_OP_COUNT; o++) {
+    for (UINTN c = 0; c < LAT_CAUSE_COUNT; c++) {
+      UINTN Count = 0;
+      UINTN Len   = 0;
+
+      for (UINTN b = 0; b < LAT_BUCKETS; b++) {
+        Count += mLat.Hist[o][c][b];
+        Len   += UnicodeSPrint(&Hist[Len], sizeof(Hist) - Len * sizeof(CHAR16), L"%s%u",
+                               (b == 0) ? L"" : L",", (UINTN)mLat.Hist[o][c][b]);
+      }
+      if (Count == 0) continue;
+
+      JsonBegin("latency");
+      JsonKeyS("op", mLatOpName[o]);
+      JsonKeyS("cause", mLatCauseName[c]);
+      JsonKeyU("count", Count);
+      JsonKeyU("outliers", mLat.Outliers[o][c]);
+      JsonKeyU("max_us", mLat.MaxUs[o][c]);
+      JsonKeyS("hist", Hist);
+      JsonEnd();
+    }
+  }
+}
+
+// Dispatch ONE EC transaction (byte read/write or bank switch).
+// Returns FALSE when the queue has nothing runnable.
+STATIC
+BOOLEAN
+EcSchedStep (
+  VOID
+  )
+{
+  EFI_STATUS Status;
+  EC_REQ     *R;
+  UINTN      Idx;
+  UINT8      Val;
+  UINT64     Tsc0;
+  UINT32     Smi0;
+
+  Idx = EcSchedPick();
+  if (Idx == EC_REQ_MAX) return FALSE;
+  R = &mReq[Idx];
+
+  // Skip bytes the cache already has (prefetch / on-demand bank loads)
+  if ((R->Flags & EC_REQ_SKIP_CACHED) != 0) {
+    while (R->Next < R->End && CacheIsValid(R->Bank, (UINT8)R->Next)) R->Next++;
+    if (R->Next >= R->End) { EcReqComplete(R, EFI_SUCCESS); return TRUE; }
+  }
+
+  // First EC transaction of the run: pick the profile before using it
+  ChipSelectProfile();
+
+  // Ports the chipset doesn't forward: fail now rather than after the wait timeouts
+  if (!DecodeBackendRouted()) { EcReqComplete(R, EFI_NO_MAPPING); return TRUE; }
+
+  if (EcReqEffectivePrio(R) < R->Prio) mSched.Promoted++;
+  if (mFirstXferTsc == 0) mFirstXferTsc = AsmReadTsc();
+
+  for (UINTN i = 0; i < EC_REQ_MAX; i++) {
+    if (i != Idx && EcReqIsPending(&mReq[i])) mReq[i].Waited++;
+  }
+
+  Smi0 = LatSmiCount();
+  Tsc0 = AsmReadTsc();
+
+  if (R->NeedBank || mEcBankSel != (INTN)R->Bank) {
+    R->NeedBank = FALSE;
+    mSched.BankSwitches++;
+    Status = EcSetBank(R->Bank);
+    LatRecord(LAT_OP_BANK, R->Bank, 0, Tsc0, Smi0);
+    if (EFI_ERROR(Status)) EcReqComplete(R, Status);
+    return TRUE;
+  }
+
+  mSched.Xfer[R->Prio]++;
+  if (R->IsWrite) {
+    UINTN Count = 1;
+
+    mWriteGen++;
+
+    // Page write: up to the end of the request or of the EEPROM page
+    if (mEc.PageWriteCmd != 0 && mEc.PageSize > 1) {
+      Count = MIN((UINTN)(R->End - R->Next), mEc.PageSize - (R->Next % mEc.PageSize));
+    }
+
+    if (Count > 1) {
+      Status = EcWriteEepromPage((UINT8)R->Next, &R->Data[R->Next], (UINT8)Count);
+      LatRecord(LAT_OP_WRITE, R->Bank, (UINT8)R->Next, Tsc0, Smi0);
+      if (EFI_ERROR(Status)) {
+        mEcBankSel = -1;   // reselect the bank before retrying
+        // Never worked on this backend, or keeps failing: the firmware doesn't
+        // take it, byte writes from now on. Otherwise retry the same page.
+        if (!mPageWriteOk || ++mPageFailRun >= PAGE_WRITE_FAIL_MAX) {
+          mSched.PageFallbacks++;
+          mEc.PageWriteCmd = 0;
+        } else {
+          mSched.PageRetries++;
+        }
+        return TRUE;
+      }
+      mPageWriteOk = TRUE;
+      mPageFailRun = 0;
+      mSched.PageWrites++;
+      mSched.WriteCycles++;
+      for (UINTN i = 0; i < Count; i++) CacheSet(R->Bank, (UINT8)(R->Next + i), R->Data[R->Next + i]);
+      R->Next = (UINT16)(R->Next + Count);
+      if (R->Next >= R->End) EcReqComplete(R, EFI_SUCCESS);
+      return TRUE;
+    }
+
+    Status = EcWriteEeprom8((UINT8)R->Next, R->Data[R->Next]);
+    LatRecord(LAT_OP_WRITE, R->Bank, (UINT8)R->Next, Tsc0, Smi0);
+    if (!EFI_ERROR(Status)) {
+      mSched.WriteCycles++;
+      CacheSet(R->Bank, (UINT8)R->Next, R->Data[R->Next]);
+    }
+  } else {
+    mSched.Reads++;
+    mWaitPolls = 0;
+    Status     = EcReadEeprom8((UINT8)R->Next, &Val);
+    // Slow because the host was in SMM: not a reason to distrust the byte
+    if (LatRecord(LAT_OP_READ, R->Bank, (UINT8)R->Next, Tsc0, Smi0)) mWaitPolls = 0;
+    if (mVote) Status = EcReadVoted(R->Bank, (UINT8)R->Next, Status, &Val);
+    if (!EFI_ERROR(Status)) CacheSet(R->Bank, (UINT8)R->Next, Val);
+  }
+
+  if (EFI_ERROR(Status)) { EcReqComplete(R, Status); return TRUE; }
+
+  R->Next++;
+  if (R->Next >= R->End) EcReqComplete(R, EFI_SUCCESS);
+  return TRUE;
+}
+
+// Blocking helper for interactive paths: run the queue until Handle is done
+STATIC
+EFI_STATUS
+EcSchedWait (
+  IN UINTN Handle
+  )
+{
+  EFI_STATUS Status;
+
+  while (!mReq[Handle].Done) {
+    if (!EcSchedStep()) break;   // blocked forever: cannot happen, but don't hang
+  }
+
+  Status = mReq[Handle].Done ? mReq[Handle].Status : EFI_DEVICE_ERROR;
+  EcReqRelease(Handle);
+  return Status;
+}
+
+// Submit + wait
+STATIC
+EFI_STATUS
+EcSchedTransfer (
+  IN EC_PRIO     Prio,
+  IN UINT8       Bank,
+  IN UINT8       Start,
+  IN UINTN       Len,
+  IN BOOLEAN     IsWrite,
+  IN CONST UINT8 *Data,   OPTIONAL
+  IN UINT8       Flags
+  )
+{
+  EFI_STATUS Status;
+  UINTN      Handle;
+
+  Status = EcReqSubmit(Prio, Bank, Start, Len, IsWrite, Data, Flags, &Handle);
+  if (EFI_ERROR(Status)) return Status;
+  return EcSchedWait(Handle);
+}
+
+// =======================================================
+//                  Write plan (sparse bank overlay)
+// =======================================================
+//
+// A plan is the set of bytes to end up in the EEPROM, per bank. Later sets
+// override earlier ones, so redundant writes disappear by construction.
+// Execution walks banks in order, selects each bank once and writes
+// contiguous runs as single scheduler requests.
+
+typedef struct {
+  UINT8 Data[EEPROM_BANK_MAX + 1][256];
+  UINT8 Mask[EEPROM_BANK_MAX + 1][256 / 8];
+} EEPROM_PLAN;
+
+typedef struct {
+  UINT32 Bytes;        // bytes written
+  UINT32 Blocks;       // contiguous runs submitted
+  UINT32 Banks;        // banks touched
+  UINT32 Skipped;      // write elision: bytes that already held the value
+  UINT32 Cycles;       // EEPROM write cycles consumed (a page write counts once)
+  UINT32 Mismatch;     // verify failures
+} PLAN_STATS;
+
+STATIC EEPROM_PLAN mPlanBulk;   // fill / copy / bulk entry
+
+// Called by PlanExecute after the last write of each bank (progress records)
+typedef
+VOID
+(*PLAN_BANK_DONE) (
+  IN UINTN Bank
+  );
+
+STATIC PLAN_BANK_DONE mPlanBankDone;
+
+STATIC
+VOID
+PlanClear (
+  OUT EEPROM_PLAN *P
+  )
+{
+  SetMem(P->Mask, sizeof(P->Mask), 0);
+}
+
+STATIC
+BOOLEAN
+PlanIsSet (
+  IN CONST EEPROM_PLAN *P,
+  IN UINTN             Bank,
+  IN UINTN             Off
+  )
+{
+  return (BOOLEAN)((P->Mask[Bank][Off >> 3] & (1u << (Off & 7))) != 0);
+}
+
+STATIC
+VOID
+PlanSet (
+  IN OUT EEPROM_PLAN *P,
+  IN     UINTN       Bank,
+  IN     UINTN       Off,
+  IN     UINT8       Val
+  )
+{
+  P->Data[Bank][Off] = Val;
+  P->Mask[Bank][Off >> 3] |= (UINT8)(1u << (Off & 7));
+}
+
+STATIC
+BOOLEAN
+PlanBankUsed (
+  IN CONST EEPROM_PLAN *P,
+  IN UINTN             Bank
+  )
+{
+  for (UINTN i = 0; i < sizeof(P->Mask[Bank]); i++) {
+    if (P->Mask[Bank][i] != 0) return TRUE;
+  }
+  return FALSE;
+}
+
+STATIC
+UINTN
+PlanCount (
+  IN CONST EEPROM_PLAN *P
+  )
+{
+  UINTN n = 0;
+  for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) {
+    for (UINTN i = 0; i < 256; i++) {
+      if (PlanIsSet(P, b, i)) n++;
+    }
+  }
+  return n;
+}
+
+// Dst = Dst overlaid with Src
+STATIC
+VOID
+PlanMerge (
+  IN OUT EEPROM_PLAN       *Dst,
+  IN     CONST EEPROM_PLAN *Src
+  )
+{
+  for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) {
+    for (UINTN i = 0; i < 256; i++) {
+      if (PlanIsSet(Src, b, i)) PlanSet(Dst, b, i, Src->Data[b][i]);
+    }
+  }
+}
+
+// Drop from Dst every byte set in Mask
+STATIC
+VOID
+PlanSubtract (
+  IN OUT EEPROM_PLAN       *Dst,
+  IN     CONST EEPROM_PLAN *Mask
+  )
+{
+  for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) {
+    for (UINTN k = 0; k < sizeof(Dst->Mask[b]); k++) Dst->Mask[b][k] &= (UINT8)~Mask->Mask[b][k];
+  }
+}
+
+// Next contiguous run of set bytes in Bank at or after *Off
+STATIC
+BOOLEAN
+PlanNextRun (
+  IN     CONST EEPROM_PLAN *P,
+  IN     UINTN             Bank,
+  IN OUT UINTN             *Off,
+  OUT    UINTN             *Len
+  )
+{
+  UINTN i = *Off;
+
+  while (i < 256 && !PlanIsSet(P, Bank, i)) i++;
+  if (i >= 256) return FALSE;
+
+  *Off = i;
+  while (i < 256 && PlanIsSet(P, Bank, i)) i++;
+  *Len = i - *Off;
+  return TRUE;
+}
+
+// Read every set byte of the plan into mCache (Data is ignored)
+STATIC
+EFI_STATUS
+PlanRead (
+  IN  CONST EEPROM_PLAN *P,
+  IN  EC_PRIO           Prio
+  )
+{
+  EFI_STATUS Status;
+  UINTN      Off, Len;
+
+  for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) {
+    UINT8 Flags = EC_REQ_FORCE_BANK;
+
+    for (Off = 0; PlanNextRun(P, b, &Off, &Len); Off += Len) {
+      Status = EcSchedTransfer(Prio, (UINT8)b, (UINT8)Off, Len, FALSE, NULL, Flags);
+      if (EFI_ERROR(Status)) return Status;
+      Flags = 0;   // one bank select per bank
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+// Bank by bank: select once, read the Reads runs, then write the Writes runs.
+// Elide: read the Writes runs first in the same bank visit and drop bytes
+// that already hold the planned value (they are removed from Writes).
+STATIC
+EFI_STATUS
+PlanExecute (
+  IN     CONST EEPROM_PLAN *Reads,   OPTIONAL
+  IN OUT EEPROM_PLAN       *Writes,
+  IN     BOOLEAN           Elide,
+  IN OUT PLAN_STATS        *St
+  )
+{
+  EFI_STATUS Status;
+  UINTN      Off, Len;
+  UINT32     Cycles0 = mSched.WriteCycles;
+
+  for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) {
+    UINT8 Flags = EC_REQ_FORCE_BANK;
+
+    if (Reads != NULL) {
+      for (Off = 0; PlanNextRun(Reads, b, &Off, &Len); Off += Len) {
+        Status = EcSchedTransfer(EC_PRIO_USER_READ, (UINT8)b, (UINT8)Off, Len, FALSE, NULL, Flags);
+        if (EFI_ERROR(Status)) return Status;
+        Flags = 0;
+      }
+    }
+
+    if (!PlanBankUsed(Writes, b)) continue;
+    St->Banks++;
+
+    if (Elide) {
+      for (Off = 0; PlanNextRun(Writes, b, &Off, &Len); Off += Len) {
+        Status = EcSchedTransfer(EC_PRIO_USER_READ, (UINT8)b, (UINT8)Off, Len, FALSE, NULL, Flags);
+        if (EFI_ERROR(Status)) return Status;
+        Flags = 0;
+      }
+      for (UINTN i = 0; i < 256; i++) {
+        if (!PlanIsSet(Writes, b, i) || mCache[b][i] != Writes->Data[b][i]) continue;
+        Writes->Mask[b][i >> 3] &= (UINT8)~(1u << (i & 7));
+        St->Skipped++;
+      }
+    }
+
+    for (Off = 0; PlanNextRun(Writes, b, &Off, &Len); Off += Len) {
+      Status = EcSchedTransfer(EC_PRIO_USER_WRITE, (UINT8)b, (UINT8)Off, Len, TRUE,
+                               &Writes->Data[b][Off], Flags);
+      St->Cycles += mSched.WriteCycles - Cycles0;
+      Cycles0     = mSched.WriteCycles;
+      if (EFI_ERROR(Status)) return Status;
+      Flags = 0;
+      St->Blocks++;
+      St->Bytes += (UINT32)Len;
+    }
+
+    if (mPlanBankDone != NULL) mPlanBankDone(b);
+  }
+  return EFI_SUCCESS;
+}
+
+// One read-back pass over every byte of the plan
+STATIC
+EFI_STATUS
+PlanVerify (
+  IN     CONST EEPROM_PLAN *P,
+  IN OUT PLAN_STATS        *St
+  )
+{
+  EFI_STATUS Status;
+
+  Status = PlanRead(P, EC_PRIO_VERIFY);
+  if (EFI_ERROR(Status)) return Status;
+
+  for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) {
+    for (UINTN i = 0; i < 256; i++) {
+      if (!PlanIsSet(P, b, i) || mCache[b][i] == P->Data[b][i]) continue;
+      if (mJson) {
+        St->Mismatch++;
+        EvMismatch(b, i, P->Data[b][i], mCache[b][i]);
+      } else if (St->Mismatch++ < 8) {
+        Print(L"Verify fail @Bank%u Addr 0x%02x: expect 0x%02x read 0x%02x\n",
+              b, i, P->Data[b][i], mCache[b][i]);
+      }
+    }
+  }
+  return (St->Mismatch != 0) ? EFI_DEVICE_ERROR : EFI_SUCCESS;
+}
+
+// =======================================================
+//                Bulk fill / bank-to-bank copy
+// =======================================================
+
+// Fill [Off, Off+Len) of Bank with Pat repeated
+STATIC
+EFI_STATUS
+BulkFill (
+  IN     UINT8       Bank,
+  IN     UINT8       Off,
+  IN     UINTN       Len,
+  IN     CONST UINT8 *Pat,
+  IN     UINTN       PatLen,
+  IN OUT PLAN_STATS  *St
+  )
+{
+  EFI_STATUS Status;
+
+  if (Bank > EEPROM_BANK_MAX || Len == 0 || PatLen == 0 || (UINTN)Off + Len > 256) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  PlanClear(&mPlanBulk);
+  for (UINTN i = 0; i < Len; i++) PlanSet(&mPlanBulk, Bank, Off + i, Pat[i % PatLen]);
+
+  Status = PlanExecute(NULL, &mPlanBulk, TRUE, St);
+  if (EFI_ERROR(Status)) return Status;
+  return PlanVerify(&mPlanBulk, St);
+}
+
+// Copy Len bytes: one bulk read of the source, then one visit of the
+// destination bank that reads it, skips equal bytes and writes the rest
+STATIC
+EFI_STATUS
+BulkCopy (
+  IN     UINT8      SrcBank,
+  IN     UINT8      SrcOff,
+  IN     UINT8      DstBank,
+  IN     UINT8      DstOff,
+  IN     UINTN      Len,
+  IN OUT PLAN_STATS *St
+  )
+{
+  EFI_STATUS Status;
+
+  if (SrcBank > EEPROM_BANK_MAX || DstBank > EEPROM_BANK_MAX || Len == 0 ||
+      (UINTN)SrcOff + Len > 256 || (UINTN)DstOff + Len > 256) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Status = EcSchedTransfer(EC_PRIO_USER_READ, SrcBank, SrcOff, Len, FALSE, NULL, EC_REQ_FORCE_BANK);
+  if (EFI_ERROR(Status)) return Status;
+
+  // Snapshot the source first: an overlapping copy inside one bank would
+  // otherwise read bytes the write phase already changed in mCache
+  PlanClear(&mPlanBulk);
+  for (UINTN i = 0; i < Len; i++) PlanSet(&mPlanBulk, DstBank, DstOff + i, mCache[SrcBank][SrcOff + i]);
+
+  Status = PlanExecute(NULL, &mPlanBulk, TRUE, St);
+  if (EFI_ERROR(Status)) return Status;
+  return PlanVerify(&mPlanBulk, St);
+}
+
+STATIC
+VOID
+BulkReport (
+  IN CONST CHAR16     *What,
+  IN EFI_STATUS       Status,
+  IN CONST PLAN_STATS *St
+  )
+{
+  if (mJson) {
+    JsonBegin("write");
+    JsonKeyS("op", What);
+    JsonKeyU("bytes", St->Bytes);
+    JsonKeyU("blocks", St->Blocks);
+    JsonKeyU("cycles", St->Cycles);
+    JsonKeyU("skipped", St->Skipped);
+    JsonKeyU("mismatch", St->Mismatch);
+    JsonKeyStatus(Status);
+    JsonEnd();
+    return;
+  }
+
+  Print(L"%s: wrote %u bytes in %u blocks (%u write cycles), skipped %u unchanged, verify mismatches %u: %r\n",
+        What, (UINTN)St->Bytes, (UINTN)St->Blocks, (UINTN)St->Cycles, (UINTN)St->Skipped,
+        (UINTN)St->Mismatch, Status);
+}
+
+#ifndef EEPROMEC_CLI_ONLY
+
+// =======================================================
+//              Snapshot history (diff / revert)
+// =======================================================
+//
+// Each bank owns a fixed SNAP_REGION_SIZE slice of a static arena holding
+// its last SNAP_PER_BANK snapshots: the oldest is a full 256-byte keyframe,
+// every later one a delta against its predecessor, encoded as runs of
+// { Off, Len, Bytes[Len] }. A delta that would not be smaller than the bank
+// is stored as another 256-byte keyframe instead (Size 256 marks one). A
+// snapshot identical to the newest one is not stored. When the count or the
+// slice runs out, the oldest snapshot is dropped and its successor becomes
+// the new keyframe.
+
+#define SNAP_PER_BANK           8
+#define SNAP_REGION_SIZE        2048
+#define SNAP_DELTA_MAX          384   // every other byte changed: 128 runs of 2 + 1
+
+typedef struct {
+  UINT32 Id;
+  UINT16 Off;         // into the bank's arena slice
+  UINT16 Size;
+  UINT16 Changed;     // bytes differing from the previous snapshot
+  UINT64 TimeUs;
+} SNAP_META;
+
+typedef struct {
+  UINTN     Count;
+  UINT16    Used;
+  SNAP_META Meta[SNAP_PER_BANK];
+} SNAP_BANK;
+
+STATIC UINT8     mSnapArena[EEPROM_BANK_MAX + 1][SNAP_REGION_SIZE];
+STATIC SNAP_BANK mSnap[EEPROM_BANK_MAX + 1];
+STATIC UINT32    mSnapNextId = 1;
+
+STATIC
+VOID
+SnapApplyDelta (
+  IN OUT UINT8       *Buf,
+  IN     CONST UINT8 *Delta,
+  IN     UINTN       Size
+  )
+{
+  UINTN i = 0;
+
+  if (Size == 256) {   // keyframe
+    CopyMem(Buf, Delta, 256);
+    return;
+  }
+
+  while (i + 2 <= Size) {
+    UINTN Off = Delta[i];
+    UINTN Len = Delta[i + 1];
+    CopyMem(&Buf[Off], &Delta[i + 2], Len);
+    i += 2 + Len;
+  }
+}
+
+// Rebuild snapshot Idx of Bank into Out[256]
+STATIC
+VOID
+SnapRebuild (
+  IN  UINTN Bank,
+  IN  UINTN Idx,
+  OUT UINT8 *Out
+  )
+{
+  SNAP_BANK *Sb = &mSnap[Bank];
+
+  CopyMem(Out, &mSnapArena[Bank][Sb->Meta[0].Off], 256);
+  for (UINTN k = 1; k <= Idx; k++) {
+    SnapApplyDelta(Out, &mSnapArena[Bank][Sb->Meta[k].Off], Sb->Meta[k].Size);
+  }
+}
+
+// Encode Cur against Prev into Out[SNAP_DELTA_MAX]; returns the delta size (0 = identical)
+STATIC
+UINTN
+SnapEncodeDelta (
+  IN  CONST UINT8 *Prev,
+  IN  CONST UINT8 *Cur,
+  OUT UINT8       *Out,
+  OUT UINTN       *Changed
+  )
+{
+  UINTN n = 0;
+  UINTN i = 0;
+
+  *Changed = 0;
+  while (i < 256) {
+    UINTN Start;
+
+    if (Prev[i] == Cur[i]) { i++; continue; }
+
+    Start = i;
+    while (i < 256 && i - Start < 255 && Prev[i] != Cur[i]) i++;
+
+    Out[n++] = (UINT8)Start;
+    Out[n++] = (UINT8)(i - Start);
+    CopyMem(&Out[n], &Cur[Start], i - Start);
+    n += i - Start;
+    *Changed += i - Start;
+  }
+  return n;
+}
+
+STATIC
+VOID
+SnapDropOldest (
+  IN UINTN Bank
+  )
+{
+  SNAP_BANK *Sb = &mSnap[Bank];
+  UINT8     Key[256];
+  UINT16    Base, Tail;
+
+  if (Sb->Count <= 1) {
+    Sb->Count = 0;
+    Sb->Used  = 0;
+    return;
+  }
+
+  // Successor becomes the keyframe, later deltas slide down behind it
+  SnapRebuild(Bank, 1, Key);
+  Base = (Sb->Count > 2) ? Sb->Meta[2].Off : Sb->Used;
+  Tail = (UINT16)(Sb->Used - Base);
+  if (Tail != 0) CopyMem(&mSnapArena[Bank][256], &mSnapArena[Bank][Base], Tail);   // overlap-safe
+  CopyMem(&mSnapArena[Bank][0], Key, 256);
+
+  for (UINTN k = 2; k < Sb->Count; k++) {
+    Sb->Meta[k].Off = (UINT16)(Sb->Meta[k].Off - Base + 256);
+  }
+  CopyMem(&Sb->Meta[0], &Sb->Meta[1], (Sb->Count - 1) * sizeof(SNAP_META));
+  Sb->Meta[0].Off  = 0;
+  Sb->Meta[0].Size = 256;
+  Sb->Count--;
+  Sb->Used = (UINT16)(256 + Tail);
+}
+
+// Record the cached content of Bank (only when the whole bank is cached)
+STATIC
+VOID
+SnapTake (
+  IN UINTN Bank
+  )
+{
+  SNAP_BANK *Sb = &mSnap[Bank];
+  UINT8     Prev[256];
+  UINT8     Delta[SNAP_DELTA_MAX];
+  UINTN     Size, Changed;
+  SNAP_META *M;
+
+  if (!CacheBankComplete((UINT8)Bank)) return;
+
+  if (Sb->Count > 0) {
+    SnapRebuild(Bank, Sb->Count - 1, Prev);
+    Size = SnapEncodeDelta(Prev, mCache[Bank], Delta, &Changed);
+    if (Size == 0) return;   // unchanged: dedup
+    if (Size >= 256) {       // no smaller than the bank: keyframe
+      CopyMem(Delta, mCache[Bank], 256);
+      Size = 256;
+    }
+
+    while (Sb->Count > 0 && (Sb->Count == SNAP_PER_BANK || (UINTN)Sb->Used + Size > SNAP_REGION_SIZE)) {
+      SnapDropOldest(Bank);
+    }
+  }
+
+  M = &Sb->Meta[Sb->Count];
+  M->Id     = mSnapNextId++;
+  M->TimeUs = NowUs();
+  M->Off    = Sb->Used;
+
+  if (Sb->Count == 0) {
+    CopyMem(&mSnapArena[Bank][0], mCache[Bank], 256);
+    M->Size    = 256;
+    M->Changed = 0;
+  } else {
+    CopyMem(&mSnapArena[Bank][Sb->Used], Delta, Size);
+    M->Size    = (UINT16)Size;
+    M->Changed = (UINT16)Changed;
+  }
+
+  Sb->Used = (UINT16)(Sb->Used + M->Size);
+  Sb->Count++;
+}
+
+STATIC
+VOID
+SnapTakeAll (
+  VOID
+  )
+{
+  for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) SnapTake(b);
+}
+
+STATIC
+BOOLEAN
+SnapFind (
+  IN  UINT32 Id,
+  OUT UINTN  *Bank,
+  OUT UINTN  *Idx
+  )
+{
+  for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) {
+    for (UINTN k = 0; k < mSnap[b].Count; k++) {
+      if (mSnap[b].Meta[k].Id == Id) {
+        *Bank = b;
+        *Idx  = k;
+        return TRUE;
+      }
+    }
+  }
+  return FALSE;
+}
+
+STATIC
+VOID
+SnapList (
+  VOID
+  )
+{
+  for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) {
+    SNAP_BANK *Sb = &mSnap[b];
+
+    if (Sb->Count == 0) continue;
+    Print(L"Bank %u (%u/%u bytes):", b, (UINTN)Sb->Used, (UINTN)SNAP_REGION_SIZE);
+    for (UINTN k = 0; k < Sb->Count; k++) {
+      SNAP_META *M = &Sb->Meta[k];
+      Print(L"  #%x@%us", (UINTN)M->Id, (UINTN)DivU64x32(M->TimeUs - mStartUs, 1000000));
+      if (k == 0) Print(L"(key)");
+      else Print(L"(+%u)", (UINTN)M->Changed);
+    }
+    Print(L"\n");
+  }
+}
+
+// Print the bytes that differ between two snapshots of the same bank
+STATIC
+EFI_STATUS
+SnapDiff (
+  IN UINT32 IdA,
+  IN UINT32 IdB
+  )
+{
+  UINTN BankA, IdxA, BankB, IdxB, n = 0;
+  UINT8 A[256], B[256];
+
+  if (!SnapFind(IdA, &BankA, &IdxA) || !SnapFind(IdB, &BankB, &IdxB)) return EFI_NOT_FOUND;
+  if (BankA != BankB) return EFI_INVALID_PARAMETER;
+
+  SnapRebuild(BankA, IdxA, A);
+  SnapRebuild(BankB, IdxB, B);
+
+  Print(L"Bank %u: #%x -> #%x\n", BankA, (UINTN)IdA, (UINTN)IdB);
+  for (UINTN i = 0; i < 256; i++) {
+    if (A[i] == B[i]) continue;
+    Print(L"  %02x:%02x->%02x", i, (UINTN)A[i], (UINTN)B[i]);
+    if ((++n % 6) == 0) Print(L"\n");
+  }
+  if ((n % 6) != 0) Print(L"\n");
+  Print(L"%u bytes differ\n", n);
+  return EFI_SUCCESS;
+}
+
+// Put the live EEPROM back to snapshot Id: only bytes that differ now are written
+STATIC
+EFI_STATUS
+SnapRevert (
+  IN     UINT32     Id,
+  IN OUT PLAN_STATS *St
+  )
+{
+  EFI_STATUS Status;
+  UINTN      Bank, Idx;
+  UINT8      Target[256];
+
+  if (!SnapFind(Id, &Bank, &Idx)) return EFI_NOT_FOUND;
+  SnapRebuild(Bank, Idx, Target);
+
+  PlanClear(&mPlanBulk);
+  for (UINTN i = 0; i < 256; i++) PlanSet(&mPlanBulk, Bank, i, Target[i]);
+
+  Status = PlanExecute(NULL, &mPlanBulk, TRUE, St);
+  if (!EFI_ERROR(Status)) Status = PlanVerify(&mPlanBulk, St);
+  if (!EFI_ERROR(Status)) SnapTake(Bank);
+  return Status;
+}
+
+#endif // EEPROMEC_CLI_ONLY
+
+// =======================================================
+//          EC RAM paged view (lazy, viewport driven)
+// =======================================================
+//
+// The EC RAM space can be 64 KB (Index I/O), so it is never read up front.
+// Rows of COLS bytes are cached in a small LRU pool: the visible rows are
+// read on demand when drawn, a few rows above/below are read ahead one byte
+// per idle step, and rows scrolled far away get evicted.
+
+STATIC
+UINT32
+EcRamSpaceSize (
+  VOID
+  )
+{
+  if (mEc.AccessType != ACCESS_PORTIO) return 0x10000;
+  return (mEc.PortMode == PORTMODE_ACPI_62_66) ? 0x100 : 0;
+}
+
+#ifndef EEPROMEC_CLI_ONLY
+
+STATIC
+VOID
+RamPagesInvalidate (
+  VOID
+  )
+{
+  SetMem(mRamPages, sizeof(mRamPages), 0);
+}
+
+// Find the slot caching Row; with Create, claim a free or LRU slot for it
+STATIC
+RAM_PAGE *
+RamPageFind (
+  IN UINT32  Row,
+  IN BOOLEAN Create
+  )
+{
+  RAM_PAGE *Victim = NULL;
+
+  for (UINTN i = 0; i < RAM_PAGE_SLOTS; i++) {
+    RAM_PAGE *P = &mRamPages[i];
+    if (P->InUse && P->Row == Row) {
+      P->LastUse = ++mRamTick;
+      return P;
+    }
+    if (!Create) continue;
+    if (!P->InUse) {
+      if (Victim == NULL || Victim->InUse) Victim = P;
+    } else if (Victim == NULL || (Victim->InUse && P->LastUse < Victim->LastUse)) {
+      Victim = P;
+    }
+  }
+
+  if (Victim == NULL) return NULL;
+  if (Victim->InUse) mRamStats.Evicted++;
+
+  SetMem(Victim, sizeof(*Victim), 0);
+  Victim->InUse   = TRUE;
+  Victim->Row     = Row;
+  Victim->LastUse = ++mRamTick;
+  return Victim;
+}
+
+// Read the first missing byte of Row. Returns FALSE when the row is complete.
+STATIC
+BOOLEAN
+RamFillRowStep (
+  IN  UINT32     Row,
+  OUT EFI_STATUS *Status
+  )
+{
+  RAM_PAGE *P = RamPageFind(Row, TRUE);
+
+  *Status = EFI_SUCCESS;
+  if (P == NULL) return FALSE;
+
+  for (UINTN i = 0; i < COLS; i++) {
+    if ((P->ValidMask & (1u << i)) != 0) continue;
+
+    *Status = EcRamRead8((UINT16)(Row * COLS + i), &P->Data[i]);
+    if (EFI_ERROR(*Status)) return FALSE;
+
+    P->ValidMask |= (UINT16)(1u << i);
+    mRamStats.BytesRead++;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+// Visible row: read whatever is missing right now
+STATIC
+EFI_STATUS
+RamFillRow (
+  IN UINT32 Row
+  )
+{
+  EFI_STATUS Status;
+  while (RamFillRowStep(Row, &Status));
+  return Status;
+}
+
+// Idle: read ONE byte of the read-ahead margin around the viewport
+STATIC
+BOOLEAN
+RamReadAheadStep (
+  VOID
+  )
+{
+  EFI_STATUS Status;
+  UINT32     Rows = EcRamSpaceSize() / COLS;
+
+  if (mView != VIEW_ECRAM || Rows == 0 || mRamReadAheadHold) return FALSE;
+
+  for (UINT32 d = 0; d < RAM_READAHEAD_ROWS; d++) {
+    UINT32 Below = mRamTop + ROWS + d;
+    UINT32 Above = mRamTop - 1 - d;           // wraps to a huge value when mRamTop <= d
+
+    if (Below < Rows && RamFillRowStep(Below, &Status)) return TRUE;
+    if (EFI_ERROR(Status)) { mRamReadAheadHold = TRUE; return FALSE; }
+    if (mRamTop > d && RamFillRowStep(Above, &Status)) return TRUE;
+    if (EFI_ERROR(Status)) { mRamReadAheadHold = TRUE; return FALSE; }
+  }
+  return FALSE;
+}
+
+// Keep the cursor inside the space and the viewport on the cursor
+STATIC
+VOID
+RamClampView (
+  VOID
+  )
+{
+  UINT32 Size = EcRamSpaceSize();
+  UINT32 Rows = Size / COLS;
+  UINT32 Row;
+
+  if (Size == 0) { mRamCursor = 0; mRamTop = 0; return; }
+  if (mRamCursor >= Size) mRamCursor = Size - 1;
+
+  Row = mRamCursor / COLS;
+  if (Row < mRamTop) mRamTop = Row;
+  if (Row >= mRamTop + ROWS) mRamTop = Row - ROWS + 1;
+  if (Rows >= ROWS && mRamTop > Rows - ROWS) mRamTop = Rows - ROWS;
+}
+
+#endif // EEPROMEC_CLI_ONLY
+
+// =======================================================
+//                       UI helpers
+// =======================================================
+
+STATIC
+BOOLEAN
+IsPrintableAscii (
+  IN UINT8 b
+  )
+{
+  return (BOOLEAN)(b >= 0x20 && b <= 0x7E);
+}
+
+#ifndef EEPROMEC_CLI_ONLY
+
+STATIC
+UINT16
+ReadU16LE (
+  IN UINTN Off
+  )
+{
+  return (UINT16)(mDump[Off] | ((UINT16)mDump[Off + 1] << 8));
+}
+
+STATIC
+UINT32
+ReadU32LE (
+  IN UINTN Off
+  )
+{
+  return (UINT32)(mDump[Off] |
+                 ((UINT32)mDump[Off + 1] << 8) |
+                 ((UINT32)mDump[Off + 2] << 16) |
+                 ((UINT32)mDump[Off + 3] << 24));
+}
+
+STATIC
+VOID
+AlignCursorToMode (
+  VOID
+  )
+{
+  UINT8 col = (UINT8)(mCursor % COLS);
+  UINT8 row = (UINT8)(mCursor / COLS);
+
+  if (mDispMode == DISP_WORD) {
+    col = (UINT8)(col & ~1u);
+  } else if (mDispMode == DISP_DWORD) {
+    col = (UINT8)(col & ~3u);
+  }
+  mCursor = (UINT8)(row * COLS + col);
+}
+
+STATIC
+VOID
+CycleDispMode (
+  VOID
+  )
+{
+  if (mDispMode == DISP_BYTE) mDispMode = DISP_WORD;
+  else if (mDispMode == DISP_WORD) mDispMode = DISP_DWORD;
+  else mDispMode = DISP_BYTE;
+
+  AlignCursorToMode();
+}
+
+STATIC
+VOID
+MoveCursor (
+  IN INTN dRow,
+  IN INTN dCol
+  )
+{
+  INTN row = (INTN)(mCursor / COLS);
+  INTN col = (INTN)(mCursor % COLS);
+
+  row += dRow;
+
+  if (dCol != 0) {
+    INTN step = (INTN)mDispMode; // 1/2/4
+    col += dCol * step;
+
+    if (mDispMode == DISP_WORD) col &= ~1;
+    else if (mDispMode == DISP_DWORD) col &= ~3;
+  }
+
+  if (row < 0) row = 0;
+  if (row >= (INTN)ROWS) row = (INTN)ROWS - 1;
+  if (col < 0) col = 0;
+  if (col >= (INTN)COLS) col = (INTN)COLS - 1;
+
+  mCursor = (UINT8)(row * COLS + col);
+}
+
+STATIC
+CONST CHAR16*
+AccessName (
+  VOID
+  )
+{
+  switch (mEc.AccessType) {
+  case ACCESS_PORTIO:          return L"PortIO";
+  case ACCESS_INDEXIO_ENE:     return L"IndexIO-ENE";
+  case ACCESS_INDEXIO_NUVOTON: return L"IndexIO-Nuvoton";
+  case ACCESS_INDEXIO_ITE:     return L"IndexIO-ITE";
+  default:                     return L"Unknown";
+  }
+}
+
+STATIC
+VOID
+GetPortPairText (
+  OUT CONST CHAR16 **Text
+  )
+{
+  if (mEc.PortMode == PORTMODE_8042_60_64) *Text = L"60/64";
+  else *Text = L"62/66";
+}
+
+STATIC
+VOID
+PrintHeader (
+  VOID
+  )
+{
+  CONST CHAR16 *ModeStr =
+    (mDispMode == DISP_BYTE) ? L"BYTE" :
+    (mDispMode == DISP_WORD) ? L"WORD" : L"DWORD";
+
+  CONST CHAR16 *PortTxt = L"--";
+  GetPortPairText(&PortTxt);
+
+  PrintParenGreen(L"EEPROM/EC Tool");
+  Print(L" ");
+  // Detected chip in place of the backend list (keeps the line within 80 columns)
+  if (!mChip.Found) {
+    PrintParenGreen(L"PortIO 60/64,62/66 + IndexIO ENE/Nuvoton/ITE");
+    Print(L"\n");
+  } else {
+    PrintParenGreen(L"Chip:");
+    if (mChip.Id == 0) Print(L"%s rev %02x", mChip.Vendor, (UINTN)mChip.Rev);
+    else Print(L"%s %x rev %02x", mChip.Vendor, (UINTN)mChip.Id, (UINTN)mChip.Rev);
+    Print(L" (%s)\n", mChip.Source);
+  }
+
+  PrintParenGreen(L"Access:");
+  Print(L"%s  ", AccessName());
+
+  PrintParenGreen(L"Port:");
+  if (mEc.AccessType == ACCESS_PORTIO) Print(L"%s  ", PortTxt);
+  else Print(L"--  ");
+
+  PrintParenGreen(L"Bank:");
+  Print(L"%u  ", mBank);
+
+  Print(L"Mode:%s  ", ModeStr);
+
+  PrintParenGreen(L"Scrub:");
+  if (mScrubRate == 0) Print(L"Off  ");
+  else Print(L"%uB/s  ", (UINTN)mScrubRate);
+
+  PrintParenGreen(L"Vote:");
+  Print(mVote ? L"On" : L"Off");
+
+  if (mDumpStale) {
+    AttrCell();
+    Print(mProbing ? L"  [stale: probing...]" :
+          !DecodeBackendRouted() ? L"  [stale: not decoded]" : L"  [stale: no answer]");
+    AttrDefault();
+  }
+  Print(L"\n");
+
+  Print(L"      ");
+  for (UINTN i = 0; i < COLS; i++) Print(L"%02x ", (UINTN)i);
+  Print(L"   ASCII\n");
+}
+
+STATIC
+VOID
+PrintRow (
+  IN UINTN Row
+  )
+{
+  UINTN base = Row * COLS;
+
+  Print(L"%02x | ", (UINTN)base);
+  AttrCell();
+
+  if (mDispMode == DISP_BYTE) {
+    for (UINTN i = 0; i < COLS; i++) {
+      UINTN idx = base + i;
+      if (idx == mCursor) {
+        AttrCursorBlueBg();
+        Print(L" %02x ", (UINTN)mDump[idx]);
+        AttrCell();
+      } else if (ExtModIsSet(mBank, idx, 1)) {
+        AttrExtModified();
+        Print(L" %02x ", (UINTN)mDump[idx]);
+        AttrCell();
+      } else {
+        Print(L" %02x ", (UINTN)mDump[idx]);
+      }
+    }
+  } else if (mDispMode == DISP_WORD) {
+    for (UINTN i = 0; i < COLS; i += 2) {
+      UINTN idx = base + i;
+      UINT16 v  = ReadU16LE(idx);
+      if (mCursor == idx || mCursor == idx + 1) {
+        AttrCursorBlueBg();
+        Print(L" %04x  ", (UINTN)v);
+        AttrCell();
+      } else if (ExtModIsSet(mBank, idx, 2)) {
+        AttrExtModified();
+        Print(L" %04x  ", (UINTN)v);
+        AttrCell();
+      } else {
+        Print(L" %04x  ", (UINTN)v);
+      }
+    }
+  } else {
+    for (UINTN i = 0; i < COLS; i += 4) {
+      UINTN idx = base + i;
+      UINT32 v  = ReadU32LE(idx);
+      if (mCursor >= idx && mCursor <= idx + 3) {
+        AttrCursorBlueBg();
+        Print(L" %08x  ", (UINTN)v);
+        AttrCell();
+      } else if (ExtModIsSet(mBank, idx, 4)) {
+        AttrExtModified();
+        Print(L" %08x  ", (UINTN)v);
+        AttrCell();
+      } else {
+        Print(L" %08x  ", (UINTN)v);
+      }
+    }
+  }
+
+  Print(L"  ");
+  for (UINTN i = 0; i < COLS; i++) {
+    UINTN idx = base + i;
+    UINT8 b   = mDump[idx];
+
+    if (mPreview.Active && idx >= mPreview.Off && idx < (UINTN)mPreview.Off + mPreview.Len) {
+      b = mPreview.Data[idx - mPreview.Off];
+      AttrPending();
+      Print(L"%c", IsPrintableAscii(b) ? (CHAR16)b : L'.');
+      AttrCell();
+      continue;
+    }
+    Print(L"%c", IsPrintableAscii(b) ? (CHAR16)b : L'.');
+  }
+  AttrDefault();
+  Print(L"\n");
+}
+
+// EC RAM view: draw the viewport, reading only rows that are not cached yet
+STATIC
+VOID
+RenderEcRam (
+  VOID
+  )
+{
+  EFI_STATUS Status = EFI_SUCCESS;
+  UINT32     Size   = EcRamSpaceSize();
+
+  gST->ConOut->ClearScreen(gST->ConOut);
+
+  PrintParenGreen(L"EEPROM/EC Tool");
+  Print(L" ");
+  PrintParenGreen(L"EC RAM view");
+  Print(L"\n");
+
+  PrintParenGreen(L"Access:");
+  Print(L"%s  ", AccessName());
+  PrintParenGreen(L"Space:");
+  Print(L"0x%x bytes  ", (UINTN)Size);
+  PrintParenGreen(L"Addr:");
+  Print(L"0x%04x\n", (UINTN)mRamCursor);
+
+  if (Size == 0) {
+    Print(L"\nEC RAM is not reachable through 60/64. Use F2 (62/66) or I (Index I/O).\n");
+  } else {
+    Print(L"        ");
+    for (UINTN i = 0; i < COLS; i++) Print(L"%02x ", i);
+    Print(L"   ASCII\n");
+
+    for (UINT32 r = mRamTop; r < mRamTop + ROWS && r < Size / COLS; r++) {
+      RAM_PAGE *P;
+
+      if (!EFI_ERROR(Status)) Status = RamFillRow(r);
+      P = RamPageFind(r, FALSE);
+
+      Print(L"%04x | ", (UINTN)(r * COLS));
+      for (UINTN i = 0; i < COLS; i++) {
+        BOOLEAN Ok = (BOOLEAN)(P != NULL && (P->ValidMask & (1u << i)) != 0);
+        if (r * COLS + i == mRamCursor) AttrCursorBlueBg();
+        if (Ok) Print(L" %02x", (UINTN)P->Data[i]);
+        else Print(L" ??");
+        if (r * COLS + i == mRamCursor) AttrDefault();
+      }
+      Print(L"    ");
+      for (UINTN i = 0; i < COLS; i++) {
+        BOOLEAN Ok = (BOOLEAN)(P != NULL && (P->ValidMask & (1u << i)) != 0);
+        Print(L"%c", (Ok && IsPrintableAscii(P->Data[i])) ? (CHAR16)P->Data[i] : L'.');
+      }
+      Print(L"\n");
+    }
+  }
+
+  Print(L"\nKeys: ");
+  PrintParenGreen(L"Arrows");    Print(L"=Move  ");
+  PrintParenGreen(L"PgUp/PgDn"); Print(L"=Page  ");
+  PrintParenGreen(L"R");         Print(L"=Reread  ");
+  PrintParenGreen(L"E");         Print(L"=EEPROM view  ");
+  PrintParenGreen(L"I");         Print(L"=Access  ");
+  PrintParenGreen(L"D");         Print(L"=Diag  ");
+  PrintParenGreen(L"ESC");       Print(L"=Exit\n");
+
+  if (EFI_ERROR(Status)) Print(L"\nEC RAM read failed: %r\n", Status);
+  LogRenderPane();
+}
+
+STATIC
+VOID
+Render (
+  VOID
+  )
+{
+  if (mView == VIEW_ECRAM) {
+    RenderEcRam();
+    return;
+  }
+
+  gST->ConOut->ClearScreen(gST->ConOut);
+
+  PrintHeader();
+  for (UINTN r = 0; r < ROWS; r++) {
+    mRowLine[r] = gST->ConOut->Mode->CursorRow;
+    PrintRow(r);
+  }
+
+  Print(L"\nKeys: ");
+  PrintParenGreen(L"PgUp/PgDn"); Print(L"=Bank  ");
+  PrintParenGreen(L"TAB");       PrintParenGreen(L"=Mode(BYTE/WORD/DWORD)  ");
+  PrintParenGreen(L"Arrows");    Print(L"=Move  ");
+  PrintParenGreen(L"ENTER");     PrintParenGreen(L"=Write(BYTE/WORD/DWORD)  ");
+  PrintParenGreen(L"R");         Print(L"=Refresh  ");
+  PrintParenGreen(L"I");         Print(L"=Access  ");
+  PrintParenGreen(L"F1");        Print(L"=Port 60/64  ");
+  PrintParenGreen(L"F2");        Print(L"=Port 62/66  ");
+  PrintParenGreen(L"H");         Print(L"=HexStr  ");
+  PrintParenGreen(L"A");         Print(L"=ASCII  ");
+  PrintParenGreen(L"F");         Print(L"=Fill  ");
+  PrintParenGreen(L"C");         Print(L"=Copy  ");
+  PrintParenGreen(L"N");         Print(L"=Snapshots  ");
+  PrintParenGreen(L"E");         Print(L"=EC RAM  ");
+  PrintParenGreen(L"S");         Print(L"=Scrub  ");
+  PrintParenGreen(L"V");         Print(L"=Vote  ");
+  PrintParenGreen(L"D");         Print(L"=Diag  ");
+  PrintParenGreen(L"L");         Print(L"=Log  ");
+  PrintParenGreen(L"ESC");       Print(L"=Exit\n");
+
+  LogRenderPane();
+}
+
+// L: the whole event log ring
+STATIC
+VOID
+RenderLog (
+  VOID
+  )
+{
+  CHAR16 Text[LOG_TEXT_MAX];
+
+  gST->ConOut->ClearScreen(gST->ConOut);
+  PrintParenGreen(L"Event log");
+  Print(L"  %u records, %u not sent to the sink\n\n", (UINTN)mLogSeq, (UINTN)mLogDropped);
+
+  for (UINT32 s = LogFirstKept(0); s < mLogSeq; s++) {
+    CONST LOG_REC *R = &mLog[s % LOG_RING_SIZE];
+    UINT32        Us;
+    UINT64        Sec = DivU64x32Remainder(R->TimeUs - mStartUs, 1000000, &Us);
+
+    LogFormat(R, Text, sizeof(Text));
+    Print(L"%5lu.%03u %-5s %s\n", Sec, Us / 1000, mLogSevName[R->Sev], Text);
+  }
+
+  Print(L"\nPress any key to return.\n");
+}
+
+// D: diagnostics screen (scheduler / cache counters)
+STATIC
+VOID
+RenderDiag (
+  VOID
+  )
+{
+  STATIC CONST CHAR16 *PrioName[EC_PRIO_COUNT] = {
+    L"UserWrite", L"UserRead", L"Watch", L"Verify", L"Prefetch"
+  };
+  UINTN Pending = 0;
+
+  gST->ConOut->ClearScreen(gST->ConOut);
+  PrintParenGreen(L"Diagnostics");
+  Print(L"\n\n");
+
+  PrintParenGreen(L"Scheduler");
+  Print(L"\n");
+  for (UINTN i = 0; i < EC_PRIO_COUNT; i++) {
+    Print(L"  %-10s xfer=%u\n", PrioName[i], (UINTN)mSched.Xfer[i]);
+  }
+  for (UINTN i = 0; i < EC_REQ_MAX; i++) {
+    if (EcReqIsPending(&mReq[i])) Pending++;
+  }
+  Print(L"  BankSwitch=%u Merged=%u Promoted=%u Errors=%u Pending=%u\n",
+        (UINTN)mSched.BankSwitches, (UINTN)mSched.Merged, (UINTN)mSched.Promoted,
+        (UINTN)mSched.Errors, Pending);
+
+  Print(L"  WriteCycles=%u PageWrites=%u PageRetries=%u PageFallbacks=%u PageWrite=",
+        (UINTN)mSched.WriteCycles, (UINTN)mSched.PageWrites, (UINTN)mSched.PageRetries,
+        (UINTN)mSched.PageFallbacks);
+  if (mEc.PageWriteCmd == 0) Print(L"off\n");
+  else Print(L"cmd 0x%02x, %u-byte pages\n", (UINTN)mEc.PageWriteCmd, (UINTN)mEc.PageSize);
+
+  Print(L"  Vote=%s Reads=%u Voted=%u VoteReads=%u Fixed=%u Undecided=%u\n",
+        mVote ? L"on" : L"off", (UINTN)mSched.Reads, (UINTN)mSched.Voted,
+        (UINTN)mSched.VoteReads, (UINTN)mSched.VoteFixed, (UINTN)mSched.VoteUndecided);
+
+  Print(L"\n");
+  PrintParenGreen(L"Cache");
+  Print(L"\n  ");
+  for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) {
+    UINTN n = 0;
+    for (UINTN i = 0; i < 256; i++) {
+      if (CacheIsValid((UINT8)b, (UINT8)i)) n++;
+    }
+    Print(L"B%u:%3u  ", b, n);
+  }
+  Print(L"%s\n", mPrefetchHold ? L"(prefetch on hold)" : L"");
+
+  Print(L"\n");
+  PrintParenGreen(L"Scrub");
+  Print(L"\n  Rate=%uB/s Checked=%u ExtModified=%u\n",
+        (UINTN)mScrubRate, (UINTN)mScrub.Checked, (UINTN)mScrub.Mismatch);
+
+  Print(L"\n");
+  PrintParenGreen(L"Snapshots");
+  Print(L"\n  ");
+  for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) {
+    Print(L"B%u:%u/%uB  ", b, mSnap[b].Count, (UINTN)mSnap[b].Used);
+  }
+  Print(L"\n");
+
+  Print(L"\n");
+  PrintParenGreen(L"EC RAM pages");
+  Print(L"\n  Slots=%u BytesRead=%u Evicted=%u\n",
+        (UINTN)RAM_PAGE_SLOTS, (UINTN)mRamStats.BytesRead, (UINTN)mRamStats.Evicted);
+
+  Print(L"\n");
+  PrintParenGreen(L"Latency");
+  Print(L"\n");
+  if (!mLat.Armed) {
+    Print(L"  Sampling starts now: transactions from here on are counted\n");
+    LatArm();
+  } else {
+    LatPrint();
+  }
+
+  Print(L"\n");
+  PrintParenGreen(L"LPC/eSPI decode");
+  if (!mDecode.Known) {
+    Print(L"\n  00:1F.0 is %04x:%04x, not an Intel LPC/eSPI bridge: all backends tried\n",
+          (UINTN)mDecode.Vid, (UINTN)mDecode.Did);
+  } else {
+    Print(L"\n  00:1F.0 %04x:%04x IOD=%04x IOE=%04x  60/64:%s 62/66:%s 2E/2F:%s 4E/4F:%s%s\n  ",
+          (UINTN)mDecode.Vid, (UINTN)mDecode.Did, (UINTN)mDecode.Iod, (UINTN)mDecode.Ioe,
+          (mDecode.Ioe & LPC_IOE_KE)   ? L"on" : L"off", (mDecode.Ioe & LPC_IOE_MC)   ? L"on" : L"off",
+          (mDecode.Ioe & LPC_IOE_CNF1) ? L"on" : L"off", (mDecode.Ioe & LPC_IOE_CNF2) ? L"on" : L"off",
+          mDecode.Check ? L"" : L"  (check off)");
+    for (UINTN i = 0; i < LPC_GEN_COUNT; i++) {
+      UINT32 r = mDecode.Gen[i];
+      if ((r & LPC_GEN_EN) == 0) Print(L"GEN%u:off  ", i + 1);
+      else Print(L"GEN%u:%04x-%04x  ", i + 1, (UINTN)LPC_GEN_BASE(r),
+                 (UINTN)(LPC_GEN_BASE(r) | LPC_GEN_MASK(r) | 3));
+    }
+    Print(L"\n  Current backend (I/O 0x%04x): %s\n", (UINTN)DecodeBackendPort(),
+          DecodeBackendRouted() ? L"routed" : L"not decoded");
+  }
+  if (mChip.Found) {
+    Print(L"  Chip: %s ID 0x%04x rev 0x%02x from %s in %lu us\n", mChip.Vendor, (UINTN)mChip.Id,
+          (UINTN)mChip.Rev, mChip.Source, mChip.Us);
+  } else if (mAccessGiven) {
+    Print(L"  Chip: not probed (-a given)\n");
+  } else {
+    Print(L"  Chip: no ID on SIO 2E/4E or in EC RAM (%lu us)\n", mChip.Us);
+  }
+
+  Print(L"\nPress any key to return.\n");
+}
+
+// ---------------- Dump / refresh ----------------
+
+#define PROBE_SAMPLES           8     // sampled reads validating a cached bank on a new backend
+
+// Background probe of the current backend (valid while mProbing): either a
+// full reread of a bank, or PROBE_SAMPLES single-byte reads checked against
+// the cached bank when it is complete.
+STATIC struct {
+  BOOLEAN  Sampling;
+  UINT8    Bank;
+  UINTN    Count;                    // requests in Req[]
+  UINTN    Req[PROBE_SAMPLES];
+  UINT8    Off[PROBE_SAMPLES];
+  UINT8    Expect[PROBE_SAMPLES];    // cached value when the sample was queued
+  UINT8    Seed;                     // rotates the sampled offsets between probes
+  LOG_CODE FailCode;                 // logged if the probe fails
+  UINT64   FailArg;                  // leading log argument (port), before the status
+} mProbe;
+
+// mBank was just reread in full: show it
+STATIC
+VOID
+DumpFromFreshCache (
+  VOID
+  )
+{
+  CopyMem(mDump, mCache[mBank], sizeof(mDump));
+  SetMem(mExtMod[mBank], sizeof(mExtMod[mBank]), 0);   // user has seen the current data
+  mPrefetchHold = FALSE;
+  mDumpStale    = FALSE;
+  SnapTake(mBank);
+}
+
+// R: reread all 256 bytes of mBank and refresh its cache
+STATIC
+EFI_STATUS
+RefreshDump (
+  VOID
+  )
+{
+  EFI_STATUS Status;
+
+  Status = EcSchedTransfer(EC_PRIO_USER_READ, mBank, 0, 256, FALSE, NULL, EC_REQ_FORCE_BANK);
+  if (EFI_ERROR(Status)) return Status;
+
+  DumpFromFreshCache();
+  return EFI_SUCCESS;
+}
+
+// Queue a full reread of mBank as the probe; FALSE if the queue is full
+STATIC
+BOOLEAN
+ProbeSubmitFull (
+  VOID
+  )
+{
+  mProbe.Sampling = FALSE;
+  mProbe.Bank     = mBank;
+  mProbe.Count    = 1;
+  return (BOOLEAN)!EFI_ERROR(EcReqSubmit(EC_PRIO_USER_READ, mBank, 0, 256, FALSE, NULL,
+                                         EC_REQ_FORCE_BANK, &mProbe.Req[0]));
+}
+
+// Startup / backend switch: queue the probe and return at once. The UI
+// keeps drawing the stale dump and handling keys (including another backend
+// switch) while the idle loop runs the probe one transaction at a time;
+// RefreshPoll picks up the result. With mBank fully cached the probe is
+// PROBE_SAMPLES reads spread over the bank instead of 256.
+STATIC
+VOID
+RefreshStart (
+  IN LOG_CODE FailCode,
+  IN UINT64   FailArg
+  )
+{
+  EcBackendReset();          // also drops a probe still queued for the old backend
+  mDumpStale      = TRUE;
+  mProbe.FailCode = FailCode;
+  mProbe.FailArg  = FailArg;
+
+  if (!CacheBankComplete(mBank)) {
+    mProbing = ProbeSubmitFull();
+    return;
+  }
+
+  mProbe.Sampling = TRUE;
+  mProbe.Bank     = mBank;
+  mProbe.Count    = 0;
+  mProbe.Seed     = (UINT8)(mProbe.Seed + 37);
+  for (UINTN i = 0; i < PROBE_SAMPLES; i++) {
+    UINT8 Off = (UINT8)(i * (256 / PROBE_SAMPLES) + ((mProbe.Seed + i * 13) % (256 / PROBE_SAMPLES)));
+
+    mProbe.Off[i]    = Off;
+    mProbe.Expect[i] = mCache[mBank][Off];
+    if (EFI_ERROR(EcReqSubmit(EC_PRIO_USER_READ, mBank, Off, 1, FALSE, NULL,
+                              (i == 0) ? EC_REQ_FORCE_BANK : 0, &mProbe.Req[i]))) {
+      break;
+    }
+    mProbe.Count++;
+  }
+  mProbing = (BOOLEAN)(mProbe.Count > 0);
+}
+
+STATIC
+VOID
+RefreshPoll (
+  VOID
+  )
+{
+  EFI_STATUS Status = EFI_SUCCESS;
+  UINTN      Bad    = PROBE_SAMPLES;
+  UINT8      Got    = 0;
+
+  if (!mProbing) return;
+  for (UINTN i = 0; i < mProbe.Count; i++) {
+    if (!mReq[mProbe.Req[i]].Done) return;
+  }
+
+  for (UINTN i = 0; i < mProbe.Count; i++) {
+    EC_REQ *R = &mReq[mProbe.Req[i]];
+
+    if (EFI_ERROR(R->Status) && !EFI_ERROR(Status)) Status = R->Status;
+    if (mProbe.Sampling && !EFI_ERROR(R->Status) && Bad == PROBE_SAMPLES &&
+        mCache[mProbe.Bank][mProbe.Off[i]] != mProbe.Expect[i]) {
+      Bad = i;
+      Got = mCache[mProbe.Bank][mProbe.Off[i]];
+    }
+    EcReqRelease(mProbe.Req[i]);
+  }
+  mProbing    = FALSE;
+  mNeedRender = TRUE;
+
+  if (EFI_ERROR(Status)) {
+    if (mProbe.FailCode == LOG_PORT_SWITCH_FAILED) LOG2(LOG_ERROR, mProbe.FailCode, mProbe.FailArg, Status);
+    else LOG1(LOG_ERROR, mProbe.FailCode, Status);
+    return;
+  }
+
+  if (mProbe.Sampling) {
+    if (Bad != PROBE_SAMPLES) {
+      // Either this backend reads garbage or the EEPROM changed: trust nothing cached
+      LOG4(LOG_WARN, LOG_PROBE_CACHE_STALE, mProbe.Bank, mProbe.Off[Bad], Got, mProbe.Expect[Bad]);
+      CacheInvalidateAll();
+      mProbing = ProbeSubmitFull();
+      return;
+    }
+    LOG1(LOG_INFO, LOG_PROBE_CACHE_OK, mProbe.Count);
+  }
+
+  // PgUp/PgDn meanwhile: the bank is cached, but not the one on screen
+  if (mProbe.Bank == mBank && mDumpStale) DumpFromFreshCache();
+}
+
+// PgUp/PgDn: show mBank from cache, reading only bytes the prefetcher has not fetched yet
+STATIC
+EFI_STATUS
+LoadBankDump (
+  VOID
+  )
+{
+  EFI_STATUS Status;
+
+  if (!CacheBankComplete(mBank)) {
+    Status = EcSchedTransfer(EC_PRIO_USER_READ, mBank, 0, 256, FALSE, NULL,
+                             EC_REQ_SKIP_CACHED | EC_REQ_FORCE_BANK);
+    if (EFI_ERROR(Status)) return Status;
+    mPrefetchHold = FALSE;
+  }
+
+  CopyMem(mDump, mCache[mBank], sizeof(mDump));
+  mDumpStale = FALSE;
+  SnapTake(mBank);
+  return EFI_SUCCESS;
+}
+
+// Idle-time prefetch producer: keep one PREFETCH read queued for the
+// nearest incomplete neighbor bank (+1, -1, +2, -2 ...).
+STATIC
+VOID
+PrefetchProduce (
+  VOID
+  )
+{
+  UINTN Nb = EEPROM_BANK_MAX + 1;
+
+  if (mPrefetchReq != EC_REQ_MAX) {
+    if (mReq[mPrefetchReq].Done) {
+      // Don't keep stalling the UI on timeouts; retry after the next good refresh
+      if (EFI_ERROR(mReq[mPrefetchReq].Status)) mPrefetchHold = TRUE;
+      EcReqRelease(mPrefetchReq);
+      mPrefetchReq = EC_REQ_MAX;
+    } else {
+      return;
+    }
+  }
+
+  // Nothing answered yet on this backend: don't queue more timeouts
+  if (mPrefetchHold || mDumpStale) return;
+
+  for (UINTN d = 1; d <= PREFETCH_RADIUS; d++) {
+    for (UINTN s = 0; s < 2; s++) {
+      UINT8 Bank = (UINT8)((s == 0) ? (mBank + d) % Nb : (mBank + Nb - d) % Nb);
+
+      if (Bank == mBank || CacheBankComplete(Bank)) continue;
+      if (EFI_ERROR(EcReqSubmit(EC_PRIO_PREFETCH, Bank, 0, 256, FALSE, NULL,
+                                EC_REQ_SKIP_CACHED, &mPrefetchReq))) {
+        mPrefetchReq = EC_REQ_MAX;
+      }
+      return;
+    }
+  }
+}
+
+// Background scrub producer: at most mScrubRate bytes/s, reread one cached
+// byte (rotating over all banks by SCRUB_STRIDE) and flag it when the EEPROM
+// no longer matches what we cached.
+STATIC
+VOID
+ScrubProduce (
+  VOID
+  )
+{
+  UINT64 Now;
+
+  if (mScrub.Req != EC_REQ_MAX) {
+    EC_REQ *R = &mReq[mScrub.Req];
+
+    if (!R->Done) return;
+
+    // A local write in between makes the comparison meaningless
+    if (!EFI_ERROR(R->Status) && mScrub.Gen == mWriteGen) {
+      UINT8 Cur = mCache[mScrub.Bank][mScrub.Off];
+
+      mScrub.Checked++;
+      if (Cur != mScrub.Expect) {
+        mScrub.Mismatch++;
+        mExtMod[mScrub.Bank][mScrub.Off >> 3] |= (UINT8)(1u << (mScrub.Off & 7));
+        if (mScrub.Bank == mBank) {
+          mDump[mScrub.Off] = Cur;
+          mNeedRender       = TRUE;
+        }
+      }
+    }
+    EcReqRelease(mScrub.Req);
+    mScrub.Req = EC_REQ_MAX;
+  }
+
+  if (mScrubRate == 0) return;
+
+  Now = NowUs();
+  if (Now - mScrub.LastUs < DivU64x32(1000000, mScrubRate)) return;
+
+  for (UINTN n = 0; n < (EEPROM_BANK_MAX + 1) * 256; n++) {
+    mScrub.Pos  = (mScrub.Pos + SCRUB_STRIDE) % ((EEPROM_BANK_MAX + 1) * 256);
+    mScrub.Bank = (UINT8)(mScrub.Pos / 256);
+    mScrub.Off  = (UINT8)(mScrub.Pos % 256);
+    if (!CacheIsValid(mScrub.Bank, mScrub.Off)) continue;
+
+    mScrub.Expect = mCache[mScrub.Bank][mScrub.Off];
+    mScrub.Gen    = mWriteGen;
+    mScrub.LastUs = Now;
+    if (EFI_ERROR(EcReqSubmit(EC_PRIO_VERIFY, mScrub.Bank, mScrub.Off, 1, FALSE, NULL, 0, &mScrub.Req))) {
+      mScrub.Req = EC_REQ_MAX;
+    }
+    return;
+  }
+}
+
+// Idle hook, called between keystrokes: feed producers, then run ONE
+// transaction so any key preempts background work at byte granularity.
+STATIC
+BOOLEAN
+IdleStep (
+  VOID
+  )
+{
+  RefreshPoll();
+  PrefetchProduce();
+  ScrubProduce();
+  if (EcSchedStep()) return TRUE;
+  return RamReadAheadStep();
+}
+#endif // EEPROMEC_CLI_ONLY
+
+// ---------------- Input hex ----------------
+STATIC
+BOOLEAN
+HexCharToNibble (
+  IN  CHAR16 c,
+  OUT UINT8  *n
+  )
+{
+  if (!n) return FALSE;
+  if (c >= L'0' && c <= L'9') { *n = (UINT8)(c - L'0'); return TRUE; }
+  if (c >= L'a' && c <= L'f') { *n = (UINT8)(c - L'a' + 10); return TRUE; }
+  if (c >= L'A' && c <= L'F') { *n = (UINT8)(c - L'A' + 10); return TRUE; }
+  return FALSE;
+}
+
+#ifndef EEPROMEC_CLI_ONLY
+STATIC
+EFI_STATUS
+ReadHexValueNFromKeyboard (
+  IN  UINTN  HexDigits,     // 2/4/8
+  OUT UINT32 *OutValue
+  )
+{
+  EFI_INPUT_KEY Key;
+  UINT32 v = 0;
+  UINT8  nib;
+
+  if (!OutValue) return EFI_INVALID_PARAMETER;
+  if (HexDigits != 2 && HexDigits != 4 && HexDigits != 8) return EFI_INVALID_PARAMETER;
+
+  Print(L"\nInput %u hex digits, ", (UINTN)HexDigits);
+  PrintParenGreen(L"ESC/ENTER");
+  Print(L" to cancel: ");
+
+  for (UINTN i = 0; i < HexDigits; ) {
+    if (EFI_ERROR(gST->ConIn->ReadKeyStroke(gST->ConIn, &Key))) continue;
+
+    if (Key.ScanCode == SCAN_ESC || Key.UnicodeChar == CHAR_CARRIAGE_RETURN) {
+      Print(L"\nCanceled.\n");
+      return EFI_ABORTED;
+    }
+
+    if (HexCharToNibble(Key.UnicodeChar, &nib)) {
+      v = (v << 4) | (UINT32)nib;
+      Print(L"%c", Key.UnicodeChar);
+      i++;
+    }
+  }
+
+  Print(L"\n");
+  *OutValue = v;
+  return EFI_SUCCESS;
+}
+
+// Free-form line entry (ESC cancels, BACKSPACE edits); Buf gets ASCII only
+STATIC
+EFI_STATUS
+ReadLineFromKeyboard (
+  IN  CONST CHAR16 *Prompt,
+  OUT CHAR8        *Buf,
+  IN  UINTN        BufSize
+  )
+{
+  EFI_INPUT_KEY Key;
+  UINTN         n = 0;
+
+  if (!Buf || BufSize < 2) return EFI_INVALID_PARAMETER;
+
+  Print(L"\n%s", Prompt);
+  PrintParenGreen(L"ESC");
+  Print(L" cancels: ");
+
+  while (TRUE) {
+    if (EFI_ERROR(gST->ConIn->ReadKeyStroke(gST->ConIn, &Key))) continue;
+
+    if (Key.ScanCode == SCAN_ESC) {
+      Print(L"\nCanceled.\n");
+      return EFI_ABORTED;
+    }
+    if (Key.UnicodeChar == CHAR_CARRIAGE_RETURN) break;
+
+    if (Key.UnicodeChar == CHAR_BACKSPACE) {
+      if (n > 0) {
+        n--;
+        Print(L"\b \b");
+      }
+      continue;
+    }
+
+    if (Key.UnicodeChar >= 0x20 && Key.UnicodeChar <= 0x7E && n + 1 < BufSize) {
+      Buf[n++] = (CHAR8)Key.UnicodeChar;
+      Print(L"%c", Key.UnicodeChar);
+    }
+  }
+
+  Buf[n] = 0;
+  Print(L"\n");
+  return EFI_SUCCESS;
+}
+
+// Arbitrary-length hex string (typed or pasted). Separators such as ' ',
+// '-' and ':' are ignored so UUID/MAC text can be pasted as is. TAB toggles
+// byte order: as typed, or reversed (the string is one little-endian number).
+STATIC
+EFI_STATUS
+ReadHexStringFromKeyboard (
+  IN     UINTN   MaxBytes,
+  OUT    UINT8   *Buf,
+  OUT    UINTN   *Len,
+  IN OUT BOOLEAN *Reverse
+  )
+{
+  EFI_INPUT_KEY Key;
+  UINTN         Nibbles = 0;
+  UINT8         nib;
+
+  if (!Buf || !Len || !Reverse || MaxBytes == 0) return EFI_INVALID_PARAMETER;
+
+  Print(L"\nHex string, up to %u bytes. ", MaxBytes);
+  PrintParenGreen(L"TAB");
+  Print(L" byte order, ");
+  PrintParenGreen(L"ENTER");
+  Print(L" commit, ");
+  PrintParenGreen(L"ESC");
+  Print(L" cancel\n[%s] ", *Reverse ? L"reversed" : L"as typed");
+
+  while (TRUE) {
+    if (EFI_ERROR(gST->ConIn->ReadKeyStroke(gST->ConIn, &Key))) continue;
+
+    if (Key.ScanCode == SCAN_ESC) {
+      Print(L"\nCanceled.\n");
+      return EFI_ABORTED;
+    }
+
+    if (Key.UnicodeChar == CHAR_CARRIAGE_RETURN) {
+      if (Nibbles == 0 || (Nibbles & 1) != 0) {
+        Print(L"\nNeed an even, non-zero number of hex digits.\n");
+        return EFI_INVALID_PARAMETER;
+      }
+      break;
+    }
+
+    if (Key.UnicodeChar == CHAR_TAB) {
+      *Reverse = (BOOLEAN)!*Reverse;
+      Print(L"\n[%s] ", *Reverse ? L"reversed" : L"as typed");
+      for (UINTN i = 0; i < Nibbles; i++) {
+        Print(L"%x", (UINTN)((i & 1) ? (Buf[i / 2] & 0xF) : (Buf[i / 2] >> 4)));
+      }
+      continue;
+    }
+
+    if (Key.UnicodeChar == CHAR_BACKSPACE) {
+      if (Nibbles > 0) {
+        Nibbles--;
+        Print(L"\b \b");
+      }
+      continue;
+    }
+
+    if (!HexCharToNibble(Key.UnicodeChar, &nib)) continue;
+    if (Nibbles / 2 >= MaxBytes) continue;
+
+    if ((Nibbles & 1) == 0) Buf[Nibbles / 2] = (UINT8)(nib << 4);
+    else Buf[Nibbles / 2] |= nib;
+    Nibbles++;
+    Print(L"%c", Key.UnicodeChar);
+  }
+
+  *Len = Nibbles / 2;
+  if (*Reverse) {
+    for (UINTN i = 0; i < *Len / 2; i++) {
+      UINT8 t = Buf[i];
+      Buf[i] = Buf[*Len - 1 - i];
+      Buf[*Len - 1 - i] = t;
+    }
+  }
+
+  Print(L"\n");
+  return EFI_SUCCESS;
+}
+
+// ENTER: write by display mode (1/2/4 bytes), LE, readback verify
+STATIC
+EFI_STATUS
+WriteByModeAtCursor (
+  VOID
+  )
+{
+  EFI_STATUS Status;
+  UINTN      size   = (UINTN)mDispMode;   // 1/2/4
+  UINTN      digits = size * 2;           // 2/4/8
+  UINT32     inputVal;
+  UINT8      bytes[4];
+  UINT8      addr   = mCursor;
+
+  if ((UINTN)addr + size - 1 > 0xFF) {
+    Print(L"\nWrite overflow: addr=0x%02x size=%u\n", addr, size);
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Status = ReadHexValueNFromKeyboard(digits, &inputVal);
+  if (Status == EFI_ABORTED) return EFI_SUCCESS;
+  if (EFI_ERROR(Status)) return Status;
+
+  // LE bytes
+  for (UINTN i = 0; i < size; i++) {
+    bytes[i] = (UINT8)((inputVal >> (8 * i)) & 0xFF);
+  }
+
+  Status = EcSchedTransfer(EC_PRIO_USER_WRITE, mBank, addr, size, TRUE, bytes, EC_REQ_FORCE_BANK);
+  if (EFI_ERROR(Status)) return Status;
+
+  // readback verify + update dump
+  Status = EcSchedTransfer(EC_PRIO_VERIFY, mBank, addr, size, FALSE, NULL, 0);
+  if (EFI_ERROR(Status)) return Status;
+
+  for (UINTN i = 0; i < size; i++) {
+    UINT8 rb = mCache[mBank][addr + i];
+
+    mDump[addr + i] = rb;
+
+    if (rb != bytes[i]) {
+      Print(L"\nVerify fail @Bank%u Addr 0x%02x: expect 0x%02x read 0x%02x\n",
+            mBank, (UINT8)(addr + i), bytes[i], rb);
+      return EFI_DEVICE_ERROR;
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+#endif // EEPROMEC_CLI_ONLY
+
+// ---------------- Access toggles ----------------
+STATIC
+VOID
+ApplyProfileForAccess (
+  VOID
+  )
+{
+  if (mEc.AccessType == ACCESS_INDEXIO_ENE) {
+    // ENE
+    mEc.IndexIoBase = 0xFD60;
+    mEc.OffIndexHigh= 0x01;
+    mEc.OffIndexLow = 0x02;
+    mEc.OffData     = 0x03;
+
+    mEc.CmdBuffer             = 0xF98B;
+    mEc.DataOfCmdBuffer       = 0xF98C;
+    mEc.CmdWriteDataBuffer    = 0xF98D;
+    mEc.CmdCntl               = 0xF982;
+    mEc.CmdReturnDataBuffer   = 0xF983;
+
+    // Your doc: WriteAddr / ReadAddr / Bank share buffer in this mapping
+    mEc.BankBuf               = mEc.CmdWriteDataBuffer;
+    mEc.ReadAddrBuf           = mEc.CmdWriteDataBuffer;
+    mEc.WriteAddrBuf          = mEc.CmdWriteDataBuffer;
+    mEc.WriteDataBuf          = (UINT16)(mEc.CmdWriteDataBuffer + 1);
+
+    // Page write: count after the address, data after the count
+    mEc.PageLenBuf            = 0xF98E;
+    mEc.PageDataBuf           = 0xF98F;
+
+  } else if (mEc.AccessType == ACCESS_INDEXIO_NUVOTON) {
+    // Nuvoton
+    mEc.IndexIoBase = 0x0A00;
+    mEc.OffIndexHigh= 0x00;
+    mEc.OffIndexLow = 0x01;
+    mEc.OffData     = 0x02;
+
+    mEc.CmdBuffer             = 0x128B;
+    mEc.DataOfCmdBuffer       = 0x128C;
+    mEc.CmdWriteDataBuffer    = 0x128D;
+    mEc.CmdCntl               = 0x1282;
+    mEc.CmdReturnDataBuffer   = 0x1283;
+
+    mEc.BankBuf               = mEc.CmdWriteDataBuffer;
+    mEc.ReadAddrBuf           = mEc.CmdWriteDataBuffer;
+    mEc.WriteAddrBuf          = mEc.CmdWriteDataBuffer;
+    mEc.WriteDataBuf          = (UINT16)(mEc.CmdWriteDataBuffer + 1);
+
+    mEc.PageLenBuf            = 0x128E;
+    mEc.PageDataBuf           = 0x128F;
+
+  } else if (mEc.AccessType == ACCESS_INDEXIO_ITE) {
+    // ITE (你提供的 Base/EC RAM mapping)
+    mEc.IndexIoBase = 0x0D00;
+    mEc.OffIndexHigh= 0x01;
+    mEc.OffIndexLow = 0x02;
+    mEc.OffData     = 0x03;
+
+    mEc.CmdBuffer             = 0xC62B;
+    mEc.DataOfCmdBuffer       = 0xC62C;
+    mEc.CmdWriteDataBuffer    = 0xC62D;
+    mEc.CmdCntl               = 0xC622;
+    mEc.CmdReturnDataBuffer   = 0xC623;
+
+    mEc.BankBuf               = mEc.CmdWriteDataBuffer;
+    mEc.ReadAddrBuf           = mEc.CmdWriteDataBuffer;
+    mEc.WriteAddrBuf          = mEc.CmdWriteDataBuffer;
+    mEc.WriteDataBuf          = (UINT16)(mEc.CmdWriteDataBuffer + 1);
+
+    mEc.PageLenBuf            = 0xC62E;
+    mEc.PageDataBuf           = 0xC62F;
+  }
+
+  // Page write (all profiles): opcode and page size from -pw, mailbox from -pwbuf if given
+  mEc.PageWriteCmd = mPageWriteCmd;
+  mEc.PageSize     = mPageWriteSize;
+  if (mPageLenBuf != 0) {
+    mEc.PageLenBuf  = mPageLenBuf;
+    mEc.PageDataBuf = mPageDataBuf;
+  }
+}
+
+#ifndef EEPROMEC_CLI_ONLY
+STATIC
+VOID
+CycleAccess (
+  VOID
+  )
+{
+  // Next backend the chipset routes; all four undecoded: back where we started
+  for (UINTN n = 0; n < 4; n++) {
+    if (mEc.AccessType == ACCESS_PORTIO) mEc.AccessType = ACCESS_INDEXIO_ENE;
+    else if (mEc.AccessType == ACCESS_INDEXIO_ENE) mEc.AccessType = ACCESS_INDEXIO_NUVOTON;
+    else if (mEc.AccessType == ACCESS_INDEXIO_NUVOTON) mEc.AccessType = ACCESS_INDEXIO_ITE;
+    else mEc.AccessType = ACCESS_PORTIO;
+
+    ApplyProfileForAccess();
+    if (DecodeBackendRouted()) return;
+    LOG1(LOG_WARN, LOG_DECODE_SKIPPED, DecodeBackendPort());
+  }
+}
+#endif // EEPROMEC_CLI_ONLY
+
+// =======================================================
+//        Chip identification (automatic profile choice)
+// =======================================================
+//
+// Picking the Index I/O profile by trial costs a timeout per wrong guess.
+// The EC usually tells us what it is without any handshake:
+//   - SIO configuration ports 2E/2F or 4E/4F: ITE (MB PnP key 87 01 55 55/AA,
+//     ID at 0x20/0x21, revision at 0x22) and Nuvoton (key 87 87, SID at 0x20,
+//     revision at 0x27)
+//   - EC RAM through the vendor's Index window: ITE ECHIPID1/2/ECHIPVER at
+//     0x2000-0x2002, ENE ECHV at 0xFF00
+// Every probe is a handful of plain port reads/writes with no wait loop;
+// ports the LPC/eSPI bridge doesn't decode are not touched at all.
+
+#define SIO_REG_ITE_ID          0x20
+#define SIO_REG_ITE_REV         0x22
+#define SIO_REG_ITE_CONFIG      0x02      // write 0x02: leave MB PnP mode
+#define SIO_REG_NUVOTON_SID     0x20
+#define SIO_REG_NUVOTON_SRID    0x27
+#define SIO_NUVOTON_EXIT        0xAA
+
+#define ECRAM_ITE_CHIPID        0x2000    // ECHIPID1, ECHIPID2, ECHIPVER
+#define ECRAM_ENE_ECHV          0xFF00
+
+typedef struct {
+  UINT8          IdHi;                // first (or only) ID byte
+  EC_ACCESS_TYPE Access;
+  CONST CHAR16   *Vendor;
+} CHIP_ID;
+
+STATIC CONST CHIP_ID mChipIds[] = {
+  { 0x85, ACCESS_INDEXIO_ITE,     L"ITE" },       // IT85xx
+  { 0x55, ACCESS_INDEXIO_ITE,     L"ITE" },       // IT55xx
+  { 0x89, ACCESS_INDEXIO_ITE,     L"ITE" },       // IT89xx
+  { 0xFC, ACCESS_INDEXIO_NUVOTON, L"Nuvoton" },   // NPCE/NPCX SID
+};
+
+STATIC
+UINT8
+SioRead (
+  IN UINT16 Port,
+  IN UINT8  Reg
+  )
+{
+  IoWrite8(Port, Reg);
+  return IoRead8((UINT16)(Port + 1));
+}
+
+STATIC
+BOOLEAN
+ChipMatch (
+  IN UINT8          IdHi,
+  IN UINT8          IdLo,
+  IN UINT8          Rev,
+  IN CONST CHAR16   *Source,
+  IN EC_ACCESS_TYPE Only
+  )
+{
+  for (UINTN i = 0; i < ARRAY_SIZE(mChipIds); i++) {
+    if (mChipIds[i].IdHi != IdHi || mChipIds[i].Access != Only) continue;
+    mChip.Found  = TRUE;
+    mChip.Access = mChipIds[i].Access;
+    mChip.Vendor = mChipIds[i].Vendor;
+    mChip.Id     = (Only == ACCESS_INDEXIO_NUVOTON) ? IdHi : (UINT16)((IdHi << 8) | IdLo);
+    mChip.Rev    = Rev;
+    mChip.Source = Source;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+STATIC
+BOOLEAN
+ChipProbeSio (
+  IN UINT16       Port,
+  IN CONST CHAR16 *Source
+  )
+{
+  UINT8 Hi, Lo, Rev;
+
+  if (!DecodeCovers(Port) || !DecodeCovers((UINT16)(Port + 1))) return FALSE;
+
+  // ITE: MB PnP entry key, the last byte depends on the port
+  IoWrite8(Port, 0x87);
+  IoWrite8(Port, 0x01);
+  IoWrite8(Port, 0x55);
+  IoWrite8(Port, (Port == 0x2E) ? 0x55 : 0xAA);
+  Hi  = SioRead(Port, SIO_REG_ITE_ID);
+  Lo  = SioRead(Port, SIO_REG_ITE_ID + 1);
+  Rev = SioRead(Port, SIO_REG_ITE_REV);
+  IoWrite8(Port, SIO_REG_ITE_CONFIG);
+  IoWrite8((UINT16)(Port + 1), 0x02);
+  if (ChipMatch(Hi, Lo, (UINT8)(Rev & 0x0F), Source, ACCESS_INDEXIO_ITE)) return TRUE;
+
+  // Nuvoton
+  IoWrite8(Port, 0x87);
+  IoWrite8(Port, 0x87);
+  Hi  = SioRead(Port, SIO_REG_NUVOTON_SID);
+  Rev = SioRead(Port, SIO_REG_NUVOTON_SRID);
+  IoWrite8(Port, SIO_NUVOTON_EXIT);
+  return ChipMatch(Hi, 0, Rev, Source, ACCESS_INDEXIO_NUVOTON);
+}
+
+// ID bytes in EC RAM through the Access profile's own Index window
+STATIC
+BOOLEAN
+ChipProbeEcRam (
+  IN EC_ACCESS_TYPE Access
+  )
+{
+  EC_PROFILE Saved;
+  BOOLEAN    Found = FALSE;
+
+  CopyMem(&Saved, &mEc, sizeof(mEc));
+  mEc.AccessType = Access;
+  ApplyProfileForAccess();
+
+  if (DecodeBackendRouted()) {
+    if (Access == ACCESS_INDEXIO_ITE) {
+      Found = ChipMatch(IndexIoRead8(ECRAM_ITE_CHIPID), IndexIoRead8(ECRAM_ITE_CHIPID + 1),
+                        (UINT8)(IndexIoRead8(ECRAM_ITE_CHIPID + 2) & 0x0F), L"EC RAM", Access);
+    } else if (Access == ACCESS_INDEXIO_ENE) {
+      // No vendor byte: a window that answers with something other than a floating bus
+      UINT8 Hv = IndexIoRead8(ECRAM_ENE_ECHV);
+      if (Hv != 0x00 && Hv != 0xFF) {
+        mChip.Found  = TRUE;
+        mChip.Access = Access;
+        mChip.Vendor = L"ENE";
+        mChip.Id     = 0;
+        mChip.Rev    = Hv;
+        mChip.Source = L"EC RAM";
+        Found        = TRUE;
+      }
+    }
+  }
+
+  CopyMem(&mEc, &Saved, sizeof(mEc));
+  return Found;
+}
+
+// Runs once, on the first EC access of the run (scheduler, EC RAM read or
+// UI start), so commands that never touch the EC (-n, bench render) never
+// write the SIO keys. With -a nothing is probed. Otherwise mEc switches to
+// the chip's profile unless the chipset doesn't route that window.
+STATIC
+VOID
+ChipSelectProfile (
+  VOID
+  )
+{
+  STATIC BOOLEAN Done;
+  UINT64         T0;
+
+  if (Done) return;
+  Done = TRUE;
+
+  if (!mAccessGiven) {
+    T0 = NowUs();
+    if (!ChipProbeSio(0x2E, L"SIO 2E") && !ChipProbeSio(0x4E, L"SIO 4E") &&
+        !ChipProbeEcRam(ACCESS_INDEXIO_ITE)) {
+      ChipProbeEcRam(ACCESS_INDEXIO_ENE);
+    }
+    mChip.Us = NowUs() - T0;
+  }
+
+  if (mChip.Found) {
+    LOG4(LOG_INFO, LOG_CHIP_DETECTED, mChip.Id, mChip.Rev, mChip.Access, mChip.Us);
+    if (mEc.AccessType != mChip.Access) {
+      EC_ACCESS_TYPE Old = mEc.AccessType;
+
+      mEc.AccessType = mChip.Access;
+      ApplyProfileForAccess();
+      if (!DecodeBackendRouted()) {
+        mEc.AccessType = Old;
+        ApplyProfileForAccess();
+      }
+    }
+  }
+
+  if (!DecodeBackendRouted()) LOG1(LOG_WARN, LOG_DECODE_SKIPPED, DecodeBackendPort());
+}
+
+#ifndef EEPROMEC_CLI_ONLY
+
+// =======================================================
+//        Render benchmark (console cost, no EC I/O)
+// =======================================================
+//
+// Separates console cost from EC cost: the EEPROM view is drawn from a
+// synthetic dump, nothing is queued and the scheduler is never stepped.
+// While it runs, the ConOut entry points are wrapped to count calls; with
+// ConSplitter every counted call fans out to each physical console.
+
+#define RENDER_BENCH_FRAMES     50
+#define RENDER_BENCH_FRAMES_MAX 10000
+
+typedef enum {
+  RB_REPAINT = 0,       // same data, same cursor (TAB / D / L return path)
+  RB_SWEEP,             // cursor steps one cell per frame (arrow keys)
+  RB_REFRESH,           // every byte changes per frame (R / bank switch)
+  RB_KIND_COUNT
+} RB_KIND;
+
+STATIC CONST CHAR16 *mRbKindName[RB_KIND_COUNT] = { L"repaint", L"sweep", L"refresh" };
+
+typedef struct {
+  UINT64 Us;
+  UINT64 MaxUs;
+  UINT64 Calls;
+  UINT64 Chars;
+} RB_RESULT;
+
+STATIC struct {
+  EFI_TEXT_STRING              OutputString;
+  EFI_TEXT_SET_ATTRIBUTE       SetAttribute;
+  EFI_TEXT_CLEAR_SCREEN        ClearScreen;
+  EFI_TEXT_SET_CURSOR_POSITION SetCursorPosition;
+  UINT64                       Strings;
+  UINT64                       Chars;
+  UINT64                       Attrs;
+  UINT64                       Clears;
+  UINT64                       Moves;
+} mConCount;
+
+STATIC
+EFI_STATUS
+EFIAPI
+ConCountOutputString (
+  IN EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *This,
+  IN CHAR16                          *String
+  )
+{
+  mConCount.Strings++;
+  mConCount.Chars += StrLen(String);
+  return mConCount.OutputString(This, String);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ConCountSetAttribute (
+  IN EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *This,
+  IN UINTN                           Attribute
+  )
+{
+  mConCount.Attrs++;
+  return mConCount.SetAttribute(This, Attribute);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ConCountClearScreen (
+  IN EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *This
+  )
+{
+  mConCount.Clears++;
+  return mConCount.ClearScreen(This);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ConCountSetCursorPosition (
+  IN EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *This,
+  IN UINTN                           Column,
+  IN UINTN                           Row
+  )
+{
+  mConCount.Moves++;
+  return mConCount.SetCursorPosition(This, Column, Row);
+}
+
+STATIC
+VOID
+ConCountHook (
+  IN BOOLEAN On
+  )
+{
+  EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *Out = gST->ConOut;
+
+  if (On) {
+    mConCount.OutputString      = Out->OutputString;
+    mConCount.SetAttribute      = Out->SetAttribute;
+    mConCount.ClearScreen       = Out->ClearScreen;
+    mConCount.SetCursorPosition = Out->SetCursorPosition;
+    Out->OutputString      = ConCountOutputString;
+    Out->SetAttribute      = ConCountSetAttribute;
+    Out->ClearScreen       = ConCountClearScreen;
+    Out->SetCursorPosition = ConCountSetCursorPosition;
+  } else {
+    Out->OutputString      = mConCount.OutputString;
+    Out->SetAttribute      = mConCount.SetAttribute;
+    Out->ClearScreen       = mConCount.ClearScreen;
+    Out->SetCursorPosition = mConCount.SetCursorPosition;
+  }
+}
+
+STATIC
+UINT64
+ConCountCalls (
+  VOID
+  )
+{
+  return mConCount.Strings + mConCount.Attrs + mConCount.Clears + mConCount.Moves;
+}
+
+STATIC
+BOOLEAN
+DevicePathHasUart (
+  IN EFI_DEVICE_PATH_PROTOCOL *Dp
+  )
+{
+  for (; !IsDevicePathEnd(Dp); Dp = NextDevicePathNode(Dp)) {
+    if (DevicePathType(Dp) == MESSAGING_DEVICE_PATH && DevicePathSubType(Dp) == MSG_UART_DP) return TRUE;
+  }
+  return FALSE;
+}
+
+// Physical consoles behind gST->ConOut: the ConOut handle itself, or, when
+// it has no device path (ConSplitter), every text output that has one.
+STATIC
+VOID
+ConsoleDescribe (
+  OUT BOOLEAN *Splitter,
+  OUT UINTN   *Serial,
+  OUT UINTN   *Gop,
+  OUT UINTN   *Other
+  )
+{
+  EFI_DEVICE_PATH_PROTOCOL *Dp;
+  EFI_HANDLE               *Handles = NULL;
+  UINTN                    Count    = 0;
+  VOID                     *Iface;
+
+  *Serial = *Gop = *Other = 0;
+  *Splitter = (BOOLEAN)EFI_ERROR(gBS->HandleProtocol(gST->ConsoleOutHandle, &gEfiDevicePathProtocolGuid, (VOID **)&Dp));
+
+  if (!*Splitter) {
+    Handles = &gST->ConsoleOutHandle;
+    Count   = 1;
+  } else if (EFI_ERROR(gBS->LocateHandleBuffer(ByProtocol, &gEfiSimpleTextOutProtocolGuid, NULL, &Count, &Handles))) {
+    return;
+  }
+
+  for (UINTN i = 0; i < Count; i++) {
+    if (EFI_ERROR(gBS->HandleProtocol(Handles[i], &gEfiDevicePathProtocolGuid, (VOID **)&Dp))) continue;
+    if (!EFI_ERROR(gBS->HandleProtocol(Handles[i], &gEfiGraphicsOutputProtocolGuid, &Iface))) (*Gop)++;
+    else if (DevicePathHasUart(Dp)) (*Serial)++;
+    else (*Other)++;
+  }
+
+  if (*Splitter) FreePool(Handles);
+}
+
+STATIC
+VOID
+RenderBenchFrame (
+  IN RB_KIND Kind,
+  IN UINTN   Frame
+  )
+{
+  if (Kind == RB_SWEEP) {
+    mCursor = (UINT8)(mCursor + (UINT8)mDispMode);
+  } else if (Kind == RB_REFRESH) {
+    for (UINTN i = 0; i < sizeof(mDump); i++) mDump[i] = (UINT8)(i + Frame);
+  }
+  Render();
+}
+
+STATIC
+EFI_STATUS
+RenderBench (
+  IN UINTN Frames
+  )
+{
+  STATIC CONST DISP_MODE Modes[] = { DISP_BYTE, DISP_WORD, DISP_DWORD };
+  RB_RESULT Res[RB_KIND_COUNT][ARRAY_SIZE(Modes)];
+  BOOLEAN   Splitter;
+  UINTN     Serial, Gop, Other, Cols = 0, Rows = 0;
+  UINT64    Xfer0, Xfer1;
+
+  if (Frames == 0 || Frames > RENDER_BENCH_FRAMES_MAX) return EFI_INVALID_PARAMETER;
+
+  Xfer0 = mSched.BankSwitches;
+  for (UINTN p = 0; p < EC_PRIO_COUNT; p++) Xfer0 += mSched.Xfer[p];
+
+  mView = VIEW_EEPROM;
+  mPreview.Active = FALSE;
+  mDumpStale      = FALSE;
+  SetMem(&mConCount, sizeof(mConCount), 0);
+  SetMem(Res, sizeof(Res), 0);
+
+  ConCountHook(TRUE);
+  for (UINTN k = 0; k < RB_KIND_COUNT; k++) {
+    for (UINTN m = 0; m < ARRAY_SIZE(Modes); m++) {
+      RB_RESULT *R = &Res[k][m];
+
+      mDispMode = Modes[m];
+      mCursor   = 0;
+      for (UINTN i = 0; i < sizeof(mDump); i++) mDump[i] = (UINT8)i;
+
+      for (UINTN f = 0; f < Frames; f++) {
+        UINT64 Calls = ConCountCalls();
+        UINT64 Chars = mConCount.Chars;
+        UINT64 T0    = NowUs();
+        UINT64 Dt;
+
+        RenderBenchFrame((RB_KIND)k, f);
+
+        Dt        = NowUs() - T0;
+        R->Us    += Dt;
+        R->MaxUs  = MAX(R->MaxUs, Dt);
+        R->Calls += ConCountCalls() - Calls;
+        R->Chars += mConCount.Chars - Chars;
+      }
+    }
+  }
+  ConCountHook(FALSE);
+
+  Xfer1 = mSched.BankSwitches;
+  for (UINTN p = 0; p < EC_PRIO_COUNT; p++) Xfer1 += mSched.Xfer[p];
+
+  ConsoleDescribe(&Splitter, &Serial, &Gop, &Other);
+  gST->ConOut->QueryMode(gST->ConOut, (UINTN)gST->ConOut->Mode->Mode, &Cols, &Rows);
+
+  AttrDefault();
+  gST->ConOut->ClearScreen(gST->ConOut);
+
+  if (mJson) {
+    JsonBegin("console");
+    JsonKeyU("cols", Cols);
+    JsonKeyU("rows", Rows);
+    JsonKeyU("splitter", Splitter);
+    JsonKeyU("serial", Serial);
+    JsonKeyU("gop", Gop);
+    JsonKeyU("other", Other);
+    JsonKeyU("ec_xfer", Xfer1 - Xfer0);
+    JsonEnd();
+  } else {
+    Print(L"Render benchmark: %u frames per case, EC transactions during run: %lu\n", Frames, Xfer1 - Xfer0);
+    Print(L"Console: %ux%u, %s serial %u, GOP %u, other %u\n\n",
+          Cols, Rows, Splitter ? L"ConSplitter ->" : L"direct:", Serial, Gop, Other);
+    Print(L"Case     Mode    us/frame    max us  calls/frame  chars/frame\n");
+  }
+
+  for (UINTN k = 0; k < RB_KIND_COUNT; k++) {
+    for (UINTN m = 0; m < ARRAY_SIZE(Modes); m++) {
+      CONST RB_RESULT *R    = &Res[k][m];
+      CONST CHAR16    *Mode = (Modes[m] == DISP_BYTE) ? L"BYTE" : (Modes[m] == DISP_WORD) ? L"WORD" : L"DWORD";
+
+      if (mJson) {
+        JsonBegin("render");
+        JsonKeyS("case", mRbKindName[k]);
+        JsonKeyS("mode", Mode);
+        JsonKeyU("frames", Frames);
+        JsonKeyU("us_per_frame", DivU64x32(R->Us, (UINT32)Frames));
+        JsonKeyU("max_us", R->MaxUs);
+        JsonKeyU("calls_per_frame", DivU64x32(R->Calls, (UINT32)Frames));
+        JsonKeyU("chars_per_frame", DivU64x32(R->Chars, (UINT32)Frames));
+        JsonEnd();
+        continue;
+      }
+      Print(L"%-8s %-5s %10lu %9lu %12lu %12lu\n", mRbKindName[k], Mode,
+            DivU64x32(R->Us, (UINT32)Frames), R->MaxUs,
+            DivU64x32(R->Calls, (UINT32)Frames), DivU64x32(R->Chars, (UINT32)Frames));
+    }
+  }
+
+  if (!mJson) {
+    Print(L"\nConOut calls: OutputString %lu, SetAttribute %lu, ClearScreen %lu, SetCursorPosition %lu\n",
+          mConCount.Strings, mConCount.Attrs, mConCount.Clears, mConCount.Moves);
+  }
+  return EFI_SUCCESS;
+}
+#endif // EEPROMEC_CLI_ONLY
+
+// =======================================================
+//                File helpers (Shell file system)
+// =======================================================
+
+// Read a whole text file as ASCII. UCS-2 files (shell "edit" default) are
+// narrowed. Caller frees *Buf with FreePool.
+STATIC
+EFI_STATUS
+FileReadAllAscii (
+  IN  CONST CHAR16 *Path,
+  OUT CHAR8        **Buf,
+  OUT UINTN        *Len
+  )
+{
+  EFI_STATUS        Status;
+  SHELL_FILE_HANDLE Fh;
+  UINT64            Size;
+  UINTN             n;
+  UINT8             *Raw;
+
+  Status = ShellOpenFileByName(Path, &Fh, EFI_FILE_MODE_READ, 0);
+  if (EFI_ERROR(Status)) return Status;
+
+  Status = ShellGetFileSize(Fh, &Size);
+  if (EFI_ERROR(Status) || Size > SIZE_1MB) {
+    ShellCloseFile(&Fh);
+    return EFI_ERROR(Status) ? Status : EFI_BAD_BUFFER_SIZE;
+  }
+
+  n   = (UINTN)Size;
+  Raw = AllocatePool(n + 1);
+  if (Raw == NULL) {
+    ShellCloseFile(&Fh);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = ShellReadFile(Fh, &n, Raw);
+  ShellCloseFile(&Fh);
+  if (EFI_ERROR(Status)) {
+    FreePool(Raw);
+    return Status;
+  }
+
+  if (n >= 2 && Raw[0] == 0xFF && Raw[1] == 0xFE) {
+    UINTN j = 0;
+    for (UINTN i = 2; i + 1 < n; i += 2) Raw[j++] = (Raw[i + 1] == 0) ? Raw[i] : '?';
+    n = j;
+  }
+
+  Raw[n] = 0;
+  *Buf   = (CHAR8 *)Raw;
+  *Len   = n;
+  return EFI_SUCCESS;
+}
+
+// Open Path as a new, empty file (an existing one is deleted first)
+STATIC
+EFI_STATUS
+FileCreateEmpty (
+  IN  CONST CHAR16      *Path,
+  OUT SHELL_FILE_HANDLE *Fh
+  )
+{
+  EFI_STATUS Status;
+
+  if (!EFI_ERROR(ShellOpenFileByName(Path, Fh, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0))) {
+    ShellDeleteFile(Fh);
+  }
+
+  Status = ShellOpenFileByName(Path, Fh, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0);
+  if (EFI_ERROR(Status)) *Fh = NULL;
+  return Status;
+}
+
+// =======================================================
+//          Batch script: parser + bank-ordering optimizer
+// =======================================================
+//
+// Script format (one op per line, numbers in hex, '#' starts a comment):
+//   write  <bank>:<off> <b0> [<b1> ...]
+//   read   <bank>:<off> <len>
+//   assert <bank>:<off> <b0> [<b1> ...]
+//   fill   <bank>:<off> <len> <byte>
+//   copy   <srcbank>:<off> <dstbank>:<off> <len>
+//   barrier
+//
+// Optimizer: ops between two ordering points (assert, barrier, copy, or a
+// read of bytes written earlier in the segment) form a segment. Inside a
+// segment writes/fills collapse into one plan (last value wins), reads are
+// done first, and the segment runs bank by bank in address order. One
+// verify pass over everything written runs at the end of the script.
+
+#define SCRIPT_OP_MAX           512
+#define SCRIPT_POOL_SIZE        8192
+#define SCRIPT_TOKEN_MAX        (2 + 256)
+
+typedef enum {
+  OP_WRITE = 0,
+  OP_READ,
+  OP_ASSERT,
+  OP_FILL,
+  OP_COPY,
+  OP_BARRIER
+} SCRIPT_OP_KIND;
+
+typedef struct {
+  UINT8  Kind;        // SCRIPT_OP_KIND
+  UINT8  Bank;
+  UINT8  Off;
+  UINT8  SrcBank;     // OP_COPY
+  UINT8  SrcOff;      // OP_COPY
+  UINT8  Fill;        // OP_FILL
+  UINT16 Len;
+  UINT16 Line;
+  UINT16 Pool;        // OP_WRITE / OP_ASSERT: bytes at mScriptPool[Pool]
+} SCRIPT_OP;
+
+STATIC SCRIPT_OP   mScriptOps[SCRIPT_OP_MAX];
+STATIC UINTN       mScriptOpCount;
+STATIC UINT8       mScriptPool[SCRIPT_POOL_SIZE];
+STATIC UINTN       mScriptPoolUsed;
+
+STATIC EEPROM_PLAN mPlanSeg;      // writes of the current segment
+STATIC EEPROM_PLAN mPlanReads;    // reads of the current segment (mask only)
+STATIC EEPROM_PLAN mPlanDone;     // everything written so far, for the final verify
+
+STATIC
+BOOLEAN
+AsciiParseHex (
+  IN  CONST CHAR8 *Tok,
+  IN  UINTN       Max,
+  OUT UINTN       *Val
+  )
+{
+  UINTN v = 0;
+  UINT8 n;
+
+  if (Tok[0] == '0' && (Tok[1] == 'x' || Tok[1] == 'X')) Tok += 2;
+  if (*Tok == 0) return FALSE;
+
+  for (; *Tok != 0; Tok++) {
+    if (!HexCharToNibble((CHAR16)*Tok, &n)) return FALSE;
+    v = (v << 4) | n;
+    if (v > Max) return FALSE;
+  }
+  *Val = v;
+  return TRUE;
+}
+
+// "<bank>:<off>"
+STATIC
+BOOLEAN
+AsciiParseBankOff (
+  IN  CHAR8 *Tok,
+  OUT UINT8 *Bank,
+  OUT UINT8 *Off
+  )
+{
+  CHAR8 *Colon = Tok;
+  UINTN B, O;
+
+  while (*Colon != 0 && *Colon != ':') Colon++;
+  if (*Colon != ':') return FALSE;
+  *Colon = 0;
+
+  if (!AsciiParseHex(Tok, EEPROM_BANK_MAX, &B) || !AsciiParseHex(Colon + 1, 0xFF, &O)) return FALSE;
+  *Bank = (UINT8)B;
+  *Off  = (UINT8)O;
+  return TRUE;
+}
+
+// Split Line in place on blanks; returns the token count
+STATIC
+UINTN
+AsciiTokenize (
+  IN  CHAR8 *Line,
+  OUT CHAR8 **Tok,
+  IN  UINTN MaxTok
+  )
+{
+  UINTN n = 0;
+
+  while (*Line != 0) {
+    while (*Line == ' ' || *Line == '\t' || *Line == ',') *Line++ = 0;
+    if (*Line == 0 || *Line == '#' || *Line == ';') break;
+    if (n == MaxTok) return MaxTok + 1;
+    Tok[n++] = Line;
+    while (*Line != 0 && *Line != ' ' && *Line != '\t' && *Line != ',') Line++;
+  }
+  *Line = 0;
+  return n;
+}
+
+STATIC
+EFI_STATUS
+ScriptParseLine (
+  IN CHAR8 *Line,
+  IN UINTN LineNo
+  )
+{
+  CHAR8     *Tok[SCRIPT_TOKEN_MAX];
+  UINTN     n, v, Need;
+  SCRIPT_OP *Op;
+
+  n = AsciiTokenize(Line, Tok, SCRIPT_TOKEN_MAX);
+  if (n == 0) return EFI_SUCCESS;
+  if (n > SCRIPT_TOKEN_MAX) goto Bad;
+
+  if (mScriptOpCount == SCRIPT_OP_MAX) {
+    MsgPrint(L"Line %u: too many operations (max %u)\n", LineNo, (UINTN)SCRIPT_OP_MAX);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Op = &mScriptOps[mScriptOpCount];
+  SetMem(Op, sizeof(*Op), 0);
+  Op->Line = (UINT16)LineNo;
+
+  if (AsciiStrCmp(Tok[0], "barrier") == 0) {
+    if (n != 1) goto Bad;
+    Op->Kind = OP_BARRIER;
+
+  } else if (AsciiStrCmp(Tok[0], "write") == 0 || AsciiStrCmp(Tok[0], "assert") == 0) {
+    Op->Kind = (Tok[0][0] == 'w') ? OP_WRITE : OP_ASSERT;
+    if (n < 3 || !AsciiParseBankOff(Tok[1], &Op->Bank, &Op->Off)) goto Bad;
+    Op->Len = (UINT16)(n - 2);
+    if ((UINTN)Op->Off + Op->Len > 256) goto Range;
+    if (mScriptPoolUsed + Op->Len > SCRIPT_POOL_SIZE) {
+      MsgPrint(L"Line %u: script data too large\n", LineNo);
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Op->Pool = (UINT16)mScriptPoolUsed;
+    for (UINTN i = 2; i < n; i++) {
+      if (!AsciiParseHex(Tok[i], 0xFF, &v)) goto Bad;
+      mScriptPool[mScriptPoolUsed++] = (UINT8)v;
+    }
+
+  } else if (AsciiStrCmp(Tok[0], "read") == 0) {
+    Op->Kind = OP_READ;
+    if (n != 3 || !AsciiParseBankOff(Tok[1], &Op->Bank, &Op->Off) ||
+        !AsciiParseHex(Tok[2], 0x100, &v) || v == 0) goto Bad;
+    Op->Len = (UINT16)v;
+    if ((UINTN)Op->Off + Op->Len > 256) goto Range;
+
+  } else if (AsciiStrCmp(Tok[0], "fill") == 0) {
+    Op->Kind = OP_FILL;
+    if (n != 4 || !AsciiParseBankOff(Tok[1], &Op->Bank, &Op->Off) ||
+        !AsciiParseHex(Tok[2], 0x100, &v) || v == 0) goto Bad;
+    Op->Len = (UINT16)v;
+    if (!AsciiParseHex(Tok[3], 0xFF, &v)) goto Bad;
+    Op->Fill = (UINT8)v;
+    if ((UINTN)Op->Off + Op->Len > 256) goto Range;
+
+  } else if (AsciiStrCmp(Tok[0], "copy") == 0) {
+    Op->Kind = OP_COPY;
+    if (n != 4 || !AsciiParseBankOff(Tok[1], &Op->SrcBank, &Op->SrcOff) ||
+        !AsciiParseBankOff(Tok[2], &Op->Bank, &Op->Off) ||
+        !AsciiParseHex(Tok[3], 0x100, &v) || v == 0) goto Bad;
+    Op->Len = (UINT16)v;
+    Need    = MAX((UINTN)Op->Off, (UINTN)Op->SrcOff) + Op->Len;
+    if (Need > 256) goto Range;
+
+  } else {
+    goto Bad;
+  }
+
+  mScriptOpCount++;
+  return EFI_SUCCESS;
+
+Bad:
+  MsgPrint(L"Line %u: syntax error\n", LineNo);
+  return EFI_INVALID_PARAMETER;
+
+Range:
+  MsgPrint(L"Line %u: range crosses the end of the bank\n", LineNo);
+  return EFI_INVALID_PARAMETER;
+}
+
+STATIC
+EFI_STATUS
+ScriptParse (
+  IN CHAR8 *Text
+  )
+{
+  EFI_STATUS Status;
+  UINTN      LineNo = 1;
+  CHAR8      *Line  = Text;
+
+  mScriptOpCount  = 0;
+  mScriptPoolUsed = 0;
+
+  while (*Line != 0) {
+    CHAR8 *End = Line;
+    while (*End != 0 && *End != '\n' && *End != '\r') End++;
+    if (*End != 0) {
+      if (*End == '\r' && End[1] == '\n') *End++ = 0;
+      *End++ = 0;
+    }
+
+    Status = ScriptParseLine(Line, LineNo++);
+    if (EFI_ERROR(Status)) return Status;
+    Line = End;
+  }
+  return EFI_SUCCESS;
+}
+
+// ---------- Progress record (resumable runs) ----------
+//
+// Every real run keeps "<script>.prg" up to date: rewritten and flushed
+// after each committed bank, after each segment and during the final
+// verify, deleted when the script completes. "run -r" resumes from it when
+// the plan hash matches: finished segments are replayed without touching
+// the EC, a sparse sample of the bytes they committed is read back, and
+// execution continues at the first bank not yet committed.
+
+#define PROGRESS_SIGNATURE      SIGNATURE_32('E', 'P', 'R', 'G')
+#define PROGRESS_SAMPLES        16      // sparse verify: bytes read back per bank
+
+typedef struct {
+  UINT32 Signature;
+  UINT32 PlanHash;
+  UINT16 Segment;     // segment in progress; == segment count: final verify
+  UINT8  BankDone;    // banks of Segment already committed
+  UINT8  Verified;    // final verify: banks that passed
+} SCRIPT_PROGRESS;
+
+STATIC SCRIPT_PROGRESS   mProgress;
+STATIC SHELL_FILE_HANDLE mProgressFh;     // NULL: not recording
+STATIC EEPROM_PLAN       mPlanCopied;     // replayed copy destinations (values unknown)
+STATIC EEPROM_PLAN       mPlanBank;       // one bank of mPlanDone, for the final verify
+
+STATIC
+UINT32
+ScriptPlanHash (
+  VOID
+  )
+{
+  return CalculateCrc32(mScriptOps, mScriptOpCount * sizeof(SCRIPT_OP)) ^
+         CalculateCrc32(mScriptPool, mScriptPoolUsed);
+}
+
+STATIC
+VOID
+ProgressSave (
+  VOID
+  )
+{
+  UINTN Size = sizeof(mProgress);
+
+  if (mProgressFh == NULL) return;
+  if (EFI_ERROR(ShellSetFilePosition(mProgressFh, 0)) ||
+      EFI_ERROR(ShellWriteFile(mProgressFh, &Size, &mProgress)) ||
+      EFI_ERROR(ShellFlushFile(mProgressFh))) {
+    MsgPrint(L"Progress file write failed, no longer recording\n");
+    ShellCloseFile(&mProgressFh);
+    mProgressFh = NULL;
+  }
+}
+
+STATIC
+VOID
+ProgressBankDone (
+  IN UINTN Bank
+  )
+{
+  mProgress.BankDone |= (UINT8)(1u << Bank);
+  ProgressSave();
+}
+
+// Read back up to PROGRESS_SAMPLES bytes per bank of P, spread over its runs
+STATIC
+EFI_STATUS
+ProgressSparseVerify (
+  IN  CONST EEPROM_PLAN *P,
+  OUT UINTN             *Checked,
+  OUT UINTN             *Mismatch
+  )
+{
+  EFI_STATUS Status;
+
+  *Checked  = 0;
+  *Mismatch = 0;
+
+  for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) {
+    UINTN n = 0, Step, Seen = 0;
+    UINT8 Flags = EC_REQ_FORCE_BANK;
+
+    for (UINTN i = 0; i < 256; i++) {
+      if (PlanIsSet(P, b, i)) n++;
+    }
+    if (n == 0) continue;
+    Step = MAX(n / PROGRESS_SAMPLES, 1);
+
+    for (UINTN i = 0; i < 256; i++) {
+      if (!PlanIsSet(P, b, i) || (Seen++ % Step) != 0) continue;
+
+      Status = EcSchedTransfer(EC_PRIO_VERIFY, (UINT8)b, (UINT8)i, 1, FALSE, NULL, Flags);
+      if (EFI_ERROR(Status)) return Status;
+      Flags = 0;
+      (*Checked)++;
+      if (mCache[b][i] != P->Data[b][i]) (*Mismatch)++;
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+// Run the reads and writes collected for the current segment, then print
+// the results of its read ops. Ops [First, Last) belong to the segment.
+STATIC
+EFI_STATUS
+ScriptFlushSegment (
+  IN     UINTN      First,
+  IN     UINTN      Last,
+  IN OUT PLAN_STATS *St
+  )
+{
+  EFI_STATUS Status;
+
+  mPlanBankDone = ProgressBankDone;
+  Status = PlanExecute(&mPlanReads, &mPlanSeg, FALSE, St);
+  mPlanBankDone = NULL;
+  if (EFI_ERROR(Status)) return Status;
+
+  for (UINTN i = First; i < Last; i++) {
+    CONST SCRIPT_OP *Op = &mScriptOps[i];
+    if (Op->Kind != OP_READ) continue;
+
+    if (mJson) {
+      EvRead(Op->Bank, Op->Off, Op->Len, &mCache[Op->Bank][Op->Off]);
+      continue;
+    }
+    Print(L"read %u:%02x =", Op->Bank, Op->Off);
+    for (UINTN j = 0; j < Op->Len; j++) Print(L" %02x", mCache[Op->Bank][Op->Off + j]);
+    Print(L"\n");
+  }
+
+  PlanMerge(&mPlanDone, &mPlanSeg);
+  PlanClear(&mPlanSeg);
+  PlanClear(&mPlanReads);
+  return EFI_SUCCESS;
+}
+
+STATIC
+BOOLEAN
+PlanRangeSet (
+  IN CONST EEPROM_PLAN *P,
+  IN UINTN             Bank,
+  IN UINTN             Off,
+  IN UINTN             Len
+  )
+{
+  for (UINTN i = Off; i < Off + Len; i++) {
+    if (PlanIsSet(P, Bank, i)) return TRUE;
+  }
+  return FALSE;
+}
+
+// Final verify, bank by bank so an interrupted verify resumes where it stopped
+STATIC
+EFI_STATUS
+ScriptVerify (
+  IN OUT PLAN_STATS *St
+  )
+{
+  EFI_STATUS Status;
+  EFI_STATUS Result = EFI_SUCCESS;
+
+  for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) {
+    if (!PlanBankUsed(&mPlanDone, b) || (mProgress.Verified & (1u << b)) != 0) continue;
+
+    PlanClear(&mPlanBank);
+    CopyMem(mPlanBank.Data[b], mPlanDone.Data[b], sizeof(mPlanBank.Data[b]));
+    CopyMem(mPlanBank.Mask[b], mPlanDone.Mask[b], sizeof(mPlanBank.Mask[b]));
+
+    Status = PlanVerify(&mPlanBank, St);
+    if (Status == EFI_DEVICE_ERROR) {
+      Result = Status;
+      continue;
+    }
+    if (EFI_ERROR(Status)) return Status;
+
+    mProgress.Verified |= (UINT8)(1u << b);
+    ProgressSave();
+  }
+  return Result;
+}
+
+// Resume: completed segments (and committed banks of the interrupted one)
+// are replayed without EC access, then sparsely verified before continuing.
+// Copy destinations in replayed segments have unknown values and are left
+// out of both verifies.
+STATIC
+EFI_STATUS
+ScriptExecute (
+  IN BOOLEAN               DryRun,
+  IN CONST SCRIPT_PROGRESS *Resume   OPTIONAL
+  )
+{
+  EFI_STATUS Status;
+  PLAN_STATS St;
+  UINTN      SegStart, Segments, Requested, Checked, Mismatch;
+  UINT32     Switches0 = mSched.BankSwitches;
+  BOOLEAN    Replay;
+
+Restart:
+  SetMem(&St, sizeof(St), 0);
+  PlanClear(&mPlanSeg);
+  PlanClear(&mPlanReads);
+  PlanClear(&mPlanDone);
+  PlanClear(&mPlanCopied);
+  SegStart  = 0;
+  Segments  = 0;
+  Requested = 0;
+  Replay    = (BOOLEAN)(Resume != NULL && (Resume->Segment > 0 || Resume->BankDone != 0));
+
+  mProgress.Signature = PROGRESS_SIGNATURE;
+  mProgress.PlanHash  = ScriptPlanHash();
+  mProgress.Segment   = 0;
+  mProgress.BankDone  = 0;
+  mProgress.Verified  = 0;
+
+  for (UINTN i = 0; i <= mScriptOpCount; i++) {
+    CONST SCRIPT_OP *Op = (i < mScriptOpCount) ? &mScriptOps[i] : NULL;
+    BOOLEAN         Ordering;
+
+    // Ordering points end the segment before the op runs
+    Ordering = (BOOLEAN)(Op == NULL || Op->Kind == OP_ASSERT || Op->Kind == OP_BARRIER ||
+                         Op->Kind == OP_COPY ||
+                         (Op->Kind == OP_READ && PlanRangeSet(&mPlanSeg, Op->Bank, Op->Off, Op->Len)));
+    if (Ordering) {
+      UINTN Seg = Segments++;
+
+      if (DryRun || (Resume != NULL && Seg < Resume->Segment)) {
+        PlanMerge(&mPlanDone, &mPlanSeg);
+        PlanSubtract(&mPlanDone, &mPlanCopied);
+        PlanClear(&mPlanSeg);
+        PlanClear(&mPlanReads);
+        PlanClear(&mPlanCopied);
+      } else {
+        mProgress.Segment  = (UINT16)Seg;
+        mProgress.BankDone = 0;
+
+        // Interrupted segment: its committed banks are done unless it began
+        // with a copy, whose source may have changed since
+        if (Resume != NULL && Seg == Resume->Segment &&
+            (SegStart >= mScriptOpCount || mScriptOps[SegStart].Kind != OP_COPY)) {
+          for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) {
+            if ((Resume->BankDone & (1u << b)) == 0) continue;
+            for (UINTN k = 0; k < 256; k++) {
+              if (PlanIsSet(&mPlanSeg, b, k)) PlanSet(&mPlanDone, b, k, mPlanSeg.Data[b][k]);
+            }
+            SetMem(mPlanSeg.Mask[b], sizeof(mPlanSeg.Mask[b]), 0);
+          }
+          mProgress.BankDone = Resume->BankDone;
+        }
+
+        if (Replay) {
+          Replay = FALSE;
+          Status = ProgressSparseVerify(&mPlanDone, &Checked, &Mismatch);
+          if (EFI_ERROR(Status)) return Status;
+          MsgPrint(L"Resume at segment %u: sparse verify %u/%u bytes match\n",
+                Seg, Checked - Mismatch, Checked);
+          if (Mismatch != 0) {
+            MsgPrint(L"EEPROM changed since the interrupted run, running the whole script\n");
+            Resume = NULL;
+            goto Restart;
+          }
+        }
+
+        ProgressSave();
+        Status = ScriptFlushSegment(SegStart, i, &St);
+        if (EFI_ERROR(Status)) {
+          if (mJson) EvError(L"segment", Op ? Op->Line : 0, Status);
+          else Print(L"Segment before line %u failed: %r\n", Op ? Op->Line : 0, Status);
+          return Status;
+        }
+      }
+      SegStart = i;
+    }
+    if (Op == NULL) break;
+
+    switch (Op->Kind) {
+    case OP_WRITE:
+      for (UINTN j = 0; j < Op->Len; j++) PlanSet(&mPlanSeg, Op->Bank, Op->Off + j, mScriptPool[Op->Pool + j]);
+      Requested += Op->Len;
+      break;
+
+    case OP_FILL:
+      for (UINTN j = 0; j < Op->Len; j++) PlanSet(&mPlanSeg, Op->Bank, Op->Off + j, Op->Fill);
+      Requested += Op->Len;
+      break;
+
+    case OP_READ:
+      for (UINTN j = 0; j < Op->Len; j++) PlanSet(&mPlanReads, Op->Bank, Op->Off + j, 0);
+      break;
+
+    case OP_COPY:
+      // Source reflects everything before the copy; destination joins the next segment.
+      // The copy opens segment Segments: reread the source for the interrupted
+      // segment too (it is flushed again in full), reuse it only for earlier ones.
+      if (!DryRun && (Resume == NULL || Segments >= Resume->Segment)) {
+        Status = EcSchedTransfer(EC_PRIO_USER_READ, Op->SrcBank, Op->SrcOff, Op->Len, FALSE, NULL,
+                                 EC_REQ_FORCE_BANK);
+        if (EFI_ERROR(Status)) {
+          if (mJson) EvError(L"copy", Op->Line, Status);
+          else Print(L"Line %u: copy source read failed: %r\n", Op->Line, Status);
+          return Status;
+        }
+      } else if (!DryRun) {
+        for (UINTN j = 0; j < Op->Len; j++) PlanSet(&mPlanCopied, Op->Bank, Op->Off + j, 0);
+      }
+      for (UINTN j = 0; j < Op->Len; j++) {
+        PlanSet(&mPlanSeg, Op->Bank, Op->Off + j, mCache[Op->SrcBank][Op->SrcOff + j]);
+      }
+      Requested += Op->Len;
+      break;
+
+    case OP_ASSERT:
+      // Opens segment Segments: the interrupted run passed it only if it got
+      // to that segment. Resume->Segment moves on at the next flush, so an
+      // assert that failed right after segment S still has to run.
+      if (DryRun || (Resume != NULL && Segments <= Resume->Segment)) break;
+      Status = EcSchedTransfer(EC_PRIO_USER_READ, Op->Bank, Op->Off, Op->Len, FALSE, NULL,
+                               EC_REQ_FORCE_BANK);
+      if (EFI_ERROR(Status)) {
+        if (mJson) EvError(L"assert", Op->Line, Status);
+        else Print(L"Line %u: assert read failed: %r\n", Op->Line, Status);
+        return Status;
+      }
+      for (UINTN j = 0; j < Op->Len; j++) {
+        if (mCache[Op->Bank][Op->Off + j] != mScriptPool[Op->Pool + j]) {
+          if (mJson) {
+            EvMismatch(Op->Bank, Op->Off + j, mScriptPool[Op->Pool + j], mCache[Op->Bank][Op->Off + j]);
+            EvError(L"assert", Op->Line, EFI_COMPROMISED_DATA);
+            return EFI_COMPROMISED_DATA;
+          }
+          Print(L"Line %u: assert failed @Bank%u Addr 0x%02x: expect 0x%02x read 0x%02x\n",
+                Op->Line, Op->Bank, (UINTN)(Op->Off + j), mScriptPool[Op->Pool + j],
+                mCache[Op->Bank][Op->Off + j]);
+          return EFI_COMPROMISED_DATA;
+        }
+      }
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  MsgPrint(L"Plan: %u ops, %u segments, %u bytes requested -> %u unique bytes\n",
+        mScriptOpCount, Segments, Requested, PlanCount(&mPlanDone));
+  if (DryRun) return EFI_SUCCESS;
+
+  // All writes committed: the record now tracks the final verify
+  mProgress.Segment  = (UINT16)Segments;
+  mProgress.BankDone = 0;
+  if (Resume != NULL && Resume->Segment == Segments) {
+    if (Replay) {
+      Status = ProgressSparseVerify(&mPlanDone, &Checked, &Mismatch);
+      if (EFI_ERROR(Status)) return Status;
+      MsgPrint(L"Resume at final verify: sparse verify %u/%u bytes match\n", Checked - Mismatch, Checked);
+      if (Mismatch != 0) {
+        MsgPrint(L"EEPROM changed since the interrupted run, running the whole script\n");
+        Resume = NULL;
+        goto Restart;
+      }
+    }
+    mProgress.Verified = Resume->Verified;
+  }
+  ProgressSave();
+
+  Status = ScriptVerify(&St);
+  if (mJson) {
+    BulkReport(L"run", Status, &St);
+    return Status;
+  }
+  Print(L"Wrote %u bytes in %u blocks (%u write cycles) over %u bank visits, %u bank switches, verify %r\n",
+        (UINTN)St.Bytes, (UINTN)St.Blocks, (UINTN)St.Cycles, (UINTN)St.Banks,
+        (UINTN)(mSched.BankSwitches - Switches0), Status);
+  return Status;
+}
+
+// Resume: continue from "<Path>.prg" if it belongs to this script
+STATIC
+EFI_STATUS
+ScriptRunFile (
+  IN CONST CHAR16 *Path,
+  IN BOOLEAN      DryRun,
+  IN BOOLEAN      Resume
+  )
+{
+  EFI_STATUS      Status;
+  CHAR8           *Text;
+  UINTN           Len;
+  CHAR16          PrgPath[256];
+  SCRIPT_PROGRESS Rec;
+  BOOLEAN         HaveRec = FALSE;
+
+  Status = FileReadAllAscii(Path, &Text, &Len);
+  if (EFI_ERROR(Status)) {
+    if (mJson) EvError(L"open", 0, Status);
+    else Print(L"Cannot read %s: %r\n", Path, Status);
+    return Status;
+  }
+
+  Status = ScriptParse(Text);
+  FreePool(Text);
+  if (EFI_ERROR(Status)) return Status;
+
+  if (DryRun) return ScriptExecute(TRUE, NULL);
+
+  UnicodeSPrint(PrgPath, sizeof(PrgPath), L"%s.prg", Path);
+  Status = ShellOpenFileByName(PrgPath, &mProgressFh,
+                               EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0);
+  if (EFI_ERROR(Status)) {
+    MsgPrint(L"Cannot open %s (%r), progress is not recorded\n", PrgPath, Status);
+    mProgressFh = NULL;
+  } else if (Resume) {
+    Len = sizeof(Rec);
+    HaveRec = (BOOLEAN)(!EFI_ERROR(ShellReadFile(mProgressFh, &Len, &Rec)) && Len == sizeof(Rec) &&
+                        Rec.Signature == PROGRESS_SIGNATURE && Rec.PlanHash == ScriptPlanHash());
+  }
+  if (Resume && !HaveRec) MsgPrint(L"No progress record for this script, starting from the beginning\n");
+
+  Status = ScriptExecute(FALSE, HaveRec ? &Rec : NULL);
+
+  if (mProgressFh != NULL) {
+    if (!EFI_ERROR(Status)) ShellDeleteFile(&mProgressFh);
+    else ShellCloseFile(&mProgressFh);
+    mProgressFh = NULL;
+  }
+  return Status;
+}
+
+// =======================================================
+//        Export (raw / Intel HEX / C array / hexdump)
+// =======================================================
+//
+// Streaming: the source is read 256 bytes at a time (one EEPROM bank or one
+// EC RAM chunk) and each chunk is encoded straight into one OUT_BUF, so
+// memory use does not depend on the size of the space. Hex digits come
+// from mHexPair; records are assembled in place without a print engine.
+
+#define EXPORT_LINE             16
+
+typedef enum {
+  EXPORT_BIN = 0,
+  EXPORT_IHEX,
+  EXPORT_CARRAY,
+  EXPORT_HEXDUMP
+} EXPORT_FORMAT;
+
+typedef struct {
+  EXPORT_FORMAT Fmt;
+  OUT_BUF       *Ob;
+  UINT32        Addr;                   // address of the next byte
+  UINT16        IhexUpper;              // last type-04 upper address written
+  BOOLEAN       HavePrev;               // hexdump squeeze state
+  BOOLEAN       Squeezed;
+  UINT8         Prev[EXPORT_LINE];
+} EXPORT_STATE;
+
+STATIC OUT_BUF mExportOut;
+
+STATIC
+VOID
+ExportIhexRecord (
+  IN OUT EXPORT_STATE *Ex,
+  IN     UINT8        Type,
+  IN     UINT16       Addr,
+  IN     CONST UINT8  *Data,
+  IN     UINTN        Len
+  )
+{
+  UINT8 Sum = (UINT8)(Len + (Addr >> 8) + (Addr & 0xFF) + Type);
+
+  OutC(Ex->Ob, ':');
+  OutHex8(Ex->Ob, (UINT8)Len);
+  OutHex8(Ex->Ob, (UINT8)(Addr >> 8));
+  OutHex8(Ex->Ob, (UINT8)Addr);
+  OutHex8(Ex->Ob, Type);
+  for (UINTN i = 0; i < Len; i++) {
+    OutHex8(Ex->Ob, Data[i]);
+    Sum = (UINT8)(Sum + Data[i]);
+  }
+  OutHex8(Ex->Ob, (UINT8)(0x100 - Sum));
+  OutC(Ex->Ob, '\n');
+}
+
+// One line of up to EXPORT_LINE bytes at Ex->Addr
+STATIC
+VOID
+ExportLine (
+  IN OUT EXPORT_STATE *Ex,
+  IN     CONST UINT8  *Data,
+  IN     UINTN        Len
+  )
+{
+  UINT8 Upper[2];
+
+  switch (Ex->Fmt) {
+  case EXPORT_IHEX:
+    if ((UINT16)(Ex->Addr >> 16) != Ex->IhexUpper) {
+      Ex->IhexUpper = (UINT16)(Ex->Addr >> 16);
+      Upper[0] = (UINT8)(Ex->IhexUpper >> 8);
+      Upper[1] = (UINT8)Ex->IhexUpper;
+      ExportIhexRecord(Ex, 0x04, 0, Upper, 2);
+    }
+    ExportIhexRecord(Ex, 0x00, (UINT16)Ex->Addr, Data, Len);
+    break;
+
+  case EXPORT_CARRAY:
+    OutRaw(Ex->Ob, "  ");
+    for (UINTN i = 0; i < Len; i++) {
+      OutRaw(Ex->Ob, "0x");
+      OutHex8(Ex->Ob, Data[i]);
+      OutC(Ex->Ob, ',');
+      if (i + 1 < Len) OutC(Ex->Ob, ' ');
+    }
+    OutC(Ex->Ob, '\n');
+    break;
+
+  case EXPORT_HEXDUMP:
+    // Canonical "hexdump -C": repeated lines collapse into one "*"
+    if (Len == EXPORT_LINE && Ex->HavePrev && CompareMem(Data, Ex->Prev, EXPORT_LINE) == 0) {
+      if (!Ex->Squeezed) OutRaw(Ex->Ob, "*\n");
+      Ex->Squeezed = TRUE;
+      break;
+    }
+    Ex->Squeezed = FALSE;
+    Ex->HavePrev = TRUE;
+    CopyMem(Ex->Prev, Data, Len);
+
+    for (INTN s = 24; s >= 0; s -= 8) OutHex8(Ex->Ob, (UINT8)(Ex->Addr >> s));
+    OutC(Ex->Ob, ' ');
+    for (UINTN i = 0; i < EXPORT_LINE; i++) {
+      OutC(Ex->Ob, ' ');
+      if (i == 8) OutC(Ex->Ob, ' ');
+      if (i < Len) OutHex8(Ex->Ob, Data[i]);
+      else OutRaw(Ex->Ob, "  ");
+    }
+    OutRaw(Ex->Ob, "  |");
+    for (UINTN i = 0; i < Len; i++) OutC(Ex->Ob, IsPrintableAscii(Data[i]) ? (CHAR8)Data[i] : '.');
+    OutRaw(Ex->Ob, "|\n");
+    break;
+
+  default:
+    break;
+  }
+}
+
+STATIC
+VOID
+ExportBegin (
+  OUT EXPORT_STATE *Ex,
+  IN  EXPORT_FORMAT Fmt,
+  IN  OUT_BUF      *Ob,
+  IN  CONST CHAR8  *Name,
+  IN  UINT32       Base,
+  IN  UINTN        Size
+  )
+{
+  SetMem(Ex, sizeof(*Ex), 0);
+  Ex->Fmt  = Fmt;
+  Ex->Ob   = Ob;
+  Ex->Addr = Base;
+
+  if (Fmt == EXPORT_CARRAY) {
+    CHAR8 Head[96];
+    AsciiSPrint(Head, sizeof(Head), "const unsigned char %a[%u] = {\n", Name, Size);
+    OutRaw(Ob, Head);
+  }
+}
+
+STATIC
+VOID
+ExportChunk (
+  IN OUT EXPORT_STATE *Ex,
+  IN     CONST UINT8  *Data,
+  IN     UINTN        Len
+  )
+{
+  if (Ex->Fmt == EXPORT_BIN) {
+    OutBytes(Ex->Ob, Data, Len);
+    Ex->Addr += (UINT32)Len;
+    return;
+  }
+
+  for (UINTN i = 0; i < Len; i += EXPORT_LINE) {
+    UINTN n = MIN(Len - i, EXPORT_LINE);
+    ExportLine(Ex, &Data[i], n);
+    Ex->Addr += (UINT32)n;
+  }
+}
+
+STATIC
+VOID
+ExportEnd (
+  IN OUT EXPORT_STATE *Ex
+  )
+{
+  if (Ex->Fmt == EXPORT_IHEX) {
+    ExportIhexRecord(Ex, 0x01, 0, NULL, 0);
+  } else if (Ex->Fmt == EXPORT_CARRAY) {
+    OutRaw(Ex->Ob, "};\n");
+  } else if (Ex->Fmt == EXPORT_HEXDUMP) {
+    for (INTN s = 24; s >= 0; s -= 8) OutHex8(Ex->Ob, (UINT8)(Ex->Addr >> s));
+    OutC(Ex->Ob, '\n');
+  }
+  OutFlush(Ex->Ob);
+}
+
+// Bank: 0..EEPROM_BANK_MAX for one bank, EEPROM_BANK_MAX + 1 for all banks
+// (bank b at address b * 256); EcRam: the EC RAM space instead of EEPROM
+STATIC
+EFI_STATUS
+ExportToFile (
+  IN  CONST CHAR16  *Path,
+  IN  EXPORT_FORMAT Fmt,
+  IN  BOOLEAN       EcRam,
+  IN  UINTN         Bank,
+  OUT UINTN         *Bytes
+  )
+{
+  EFI_STATUS   Status = EFI_SUCCESS;
+  EXPORT_STATE Ex;
+  UINT8        Chunk[256];
+  UINTN        First, Last, Size;
+
+  *Bytes = 0;
+  if (EcRam) {
+    Size = EcRamSpaceSize();
+    if (Size == 0) return EFI_UNSUPPORTED;
+    First = 0;
+    Last  = Size / 256 - 1;
+  } else {
+    First = (Bank > EEPROM_BANK_MAX) ? 0 : Bank;
+    Last  = (Bank > EEPROM_BANK_MAX) ? EEPROM_BANK_MAX : Bank;
+    Size  = (Last - First + 1) * 256;
+  }
+
+  Status = FileCreateEmpty(Path, &mExportOut.Fh);
+  if (EFI_ERROR(Status)) return Status;
+  mExportOut.Len    = 0;
+  mExportOut.Status = EFI_SUCCESS;
+
+  ExportBegin(&Ex, Fmt, &mExportOut, EcRam ? "ec_ram" : "eeprom", (UINT32)(First * 256), Size);
+
+  for (UINTN k = First; k <= Last && !EFI_ERROR(Status); k++) {
+    if (EcRam) {
+      for (UINTN i = 0; i < 256 && !EFI_ERROR(Status); i++) {
+        Status = EcRamRead8((UINT16)(k * 256 + i), &Chunk[i]);
+      }
+      if (EFI_ERROR(Status)) break;
+      ExportChunk(&Ex, Chunk, 256);
+    } else {
+      Status = EcSchedTransfer(EC_PRIO_USER_READ, (UINT8)k, 0, 256, FALSE, NULL, EC_REQ_FORCE_BANK);
+      if (EFI_ERROR(Status)) break;
+      ExportChunk(&Ex, mCache[k], 256);
+    }
+    *Bytes += 256;
+  }
+
+  if (!EFI_ERROR(Status)) ExportEnd(&Ex);
+  else OutFlush(&mExportOut);
+
+  if (!EFI_ERROR(Status)) Status = mExportOut.Status;
+  ShellCloseFile(&mExportOut.Fh);
+  mExportOut.Fh = NULL;
+  return Status;
+}
+
+// =======================================================
+//          Import (Intel HEX / Motorola S-record)
+// =======================================================
+//
+// The image is read through a small line reader and each data record goes
+// straight into a write plan as (bank, offset, bytes) at linear address
+// bank * 256 + offset. Holes stay unset, so only bytes the image defines
+// are compared and written. The whole file is parsed and checked (checksums,
+// geometry) before the first EC access.
+
+#define IMPORT_CHUNK            512
+#define IMPORT_LINE_MAX         600     // longest Intel HEX line is 521 chars
+#define IMPORT_REC_MAX          260     // its bytes: count, address (2), type, 255 data, checksum
+
+typedef struct {
+  SHELL_FILE_HANDLE Fh;
+  UINTN             Pos;
+  UINTN             Len;
+  BOOLEAN           Eof;
+  UINT8             Buf[IMPORT_CHUNK];
+} LINE_READER;
+
+typedef struct {
+  UINTN Records;
+  UINTN Bytes;
+  UINTN Line;
+} IMPORT_STATS;
+
+// Next line without its terminator; EFI_END_OF_FILE when done
+STATIC
+EFI_STATUS
+LineReaderNext (
+  IN OUT LINE_READER *Lr,
+  OUT    CHAR8       *Line,
+  IN     UINTN       Size
+  )
+{
+  EFI_STATUS Status;
+  UINTN      n = 0;
+
+  while (TRUE) {
+    if (Lr->Pos == Lr->Len) {
+      if (Lr->Eof) break;
+      Lr->Len = sizeof(Lr->Buf);
+      Status  = ShellReadFile(Lr->Fh, &Lr->Len, Lr->Buf);
+      if (EFI_ERROR(Status)) return Status;
+      Lr->Pos = 0;
+      if (Lr->Len == 0) {
+        Lr->Eof = TRUE;
+        break;
+      }
+    }
+
+    if (Lr->Buf[Lr->Pos] == '\n') {
+      Lr->Pos++;
+      Line[n] = 0;
+      return EFI_SUCCESS;
+    }
+    if (Lr->Buf[Lr->Pos] != '\r') {
+      if (n + 1 == Size) return EFI_BAD_BUFFER_SIZE;
+      Line[n++] = (CHAR8)Lr->Buf[Lr->Pos];
+    }
+    Lr->Pos++;
+  }
+
+  Line[n] = 0;
+  return (n > 0) ? EFI_SUCCESS : EFI_END_OF_FILE;
+}
+
+// Hex pairs after the record mark -> bytes
+STATIC
+BOOLEAN
+ImportHexBytes (
+  IN  CONST CHAR8 *s,
+  OUT UINT8       *Out,
+  IN  UINTN       OutSize,
+  OUT UINTN       *Len
+  )
+{
+  UINTN n = 0;
+  UINT8 Hi, Lo;
+
+  for (; s[0] != 0; s += 2) {
+    if (s[1] == 0 || n == OutSize) return FALSE;
+    if (!HexCharToNibble((CHAR16)s[0], &Hi) || !HexCharToNibble((CHAR16)s[1], &Lo)) return FALSE;
+    Out[n++] = (UINT8)((Hi << 4) | Lo);
+  }
+  *Len = n;
+  return TRUE;
+}
+
+// One data record; fails if any byte falls outside the EEPROM geometry
+STATIC
+EFI_STATUS
+ImportEmit (
+  IN OUT EEPROM_PLAN  *P,
+  IN OUT IMPORT_STATS *St,
+  IN     UINT32       Addr,
+  IN     CONST UINT8  *Data,
+  IN     UINTN        Len
+  )
+{
+  if (Len == 0) return EFI_SUCCESS;
+  if ((UINT64)Addr + Len > (EEPROM_BANK_MAX + 1) * 256) {
+    MsgPrint(L"Line %u: address 0x%x..0x%x is outside the EEPROM (%u banks x 256)\n",
+             St->Line, (UINTN)Addr, (UINTN)(Addr + Len - 1), (UINTN)(EEPROM_BANK_MAX + 1));
+    return EFI_BAD_BUFFER_SIZE;
+  }
+
+  for (UINTN i = 0; i < Len; i++) PlanSet(P, (Addr + i) >> 8, (Addr + i) & 0xFF, Data[i]);
+  St->Records++;
+  St->Bytes += Len;
+  return EFI_SUCCESS;
+}
+
+// ":LLAAAATT<data>CC"
+STATIC
+EFI_STATUS
+ImportIhexLine (
+  IN     CONST CHAR8  *Line,
+  IN OUT UINT32       *Base,
+  IN OUT BOOLEAN      *Done,
+  IN OUT EEPROM_PLAN  *P,
+  IN OUT IMPORT_STATS *St
+  )
+{
+  UINT8 Rec[IMPORT_REC_MAX];
+  UINTN n;
+  UINT8 Sum = 0;
+
+  if (!ImportHexBytes(Line + 1, Rec, sizeof(Rec), &n) || n < 5 || n != (UINTN)Rec[0] + 5) return EFI_INVALID_PARAMETER;
+  for (UINTN i = 0; i < n; i++) Sum = (UINT8)(Sum + Rec[i]);
+  if (Sum != 0) return EFI_CRC_ERROR;
+
+  switch (Rec[3]) {
+  case 0x00:
+    return ImportEmit(P, St, *Base + ((UINT32)Rec[1] << 8 | Rec[2]), &Rec[4], Rec[0]);
+  case 0x01:
+    *Done = TRUE;
+    return EFI_SUCCESS;
+  case 0x02:
+    if (Rec[0] != 2) return EFI_INVALID_PARAMETER;
+    *Base = ((UINT32)Rec[4] << 8 | Rec[5]) << 4;
+    return EFI_SUCCESS;
+  case 0x04:
+    if (Rec[0] != 2) return EFI_INVALID_PARAMETER;
+    *Base = ((UINT32)Rec[4] << 8 | Rec[5]) << 16;
+    return EFI_SUCCESS;
+  case 0x03:
+  case 0x05:
+    return EFI_SUCCESS;   // start address: not meaningful for EEPROM
+  default:
+    return EFI_INVALID_PARAMETER;
+  }
+}
+
+// "Stcc<addr><data>ss"
+STATIC
+EFI_STATUS
+ImportSrecLine (
+  IN     CONST CHAR8  *Line,
+  IN OUT BOOLEAN      *Done,
+  IN OUT EEPROM_PLAN  *P,
+  IN OUT IMPORT_STATS *St
+  )
+{
+  UINT8  Rec[IMPORT_REC_MAX];
+  UINTN  n, AddrLen;
+  UINT8  Sum = 0;
+  UINT32 Addr = 0;
+
+  if (!ImportHexBytes(Line + 2, Rec, sizeof(Rec), &n) || n < 3 || n != (UINTN)Rec[0] + 1) return EFI_INVALID_PARAMETER;
+  for (UINTN i = 0; i < n; i++) Sum = (UINT8)(Sum + Rec[i]);
+  if (Sum != 0xFF) return EFI_CRC_ERROR;
+
+  switch (Line[1]) {
+  case '1': AddrLen = 2; break;
+  case '2': AddrLen = 3; break;
+  case '3': AddrLen = 4; break;
+  case '7': case '8': case '9':
+    *Done = TRUE;
+    return EFI_SUCCESS;
+  case '0': case '5': case '6':
+    return EFI_SUCCESS;   // header / record count
+  default:
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (n < 1 + AddrLen + 1) return EFI_INVALID_PARAMETER;
+  for (UINTN i = 0; i < AddrLen; i++) Addr = (Addr << 8) | Rec[1 + i];
+  return ImportEmit(P, St, Addr, &Rec[1 + AddrLen], n - 2 - AddrLen);
+}
+
+// Parse the whole image into P; nothing touches the EC
+STATIC
+EFI_STATUS
+ImportParseFile (
+  IN     CONST CHAR16 *Path,
+  IN OUT EEPROM_PLAN  *P,
+  OUT    IMPORT_STATS *St
+  )
+{
+  EFI_STATUS  Status;
+  LINE_READER *Lr;
+  CHAR8       Line[IMPORT_LINE_MAX];
+  UINT32      Base = 0;
+  BOOLEAN     Done = FALSE;
+
+  SetMem(St, sizeof(*St), 0);
+  PlanClear(P);
+
+  Lr = AllocateZeroPool(sizeof(*Lr));
+  if (Lr == NULL) return EFI_OUT_OF_RESOURCES;
+
+  Status = ShellOpenFileByName(Path, &Lr->Fh, EFI_FILE_MODE_READ, 0);
+  if (EFI_ERROR(Status)) {
+    FreePool(Lr);
+    return Status;
+  }
+
+  while (!Done) {
+    CONST CHAR8 *s;
+
+    Status = LineReaderNext(Lr, Line, sizeof(Line));
+    if (Status == EFI_END_OF_FILE) {
+      Status = EFI_SUCCESS;
+      break;
+    }
+    St->Line++;
+    if (EFI_ERROR(Status)) {
+      MsgPrint(L"Line %u: %r\n", St->Line, Status);
+      break;
+    }
+
+    for (s = Line; *s == ' ' || *s == '\t'; s++);
+    if (*s == 0) continue;
+
+    if (*s == ':')                  Status = ImportIhexLine(s, &Base, &Done, P, St);
+    else if (*s == 'S' || *s == 's') Status = ImportSrecLine(s, &Done, P, St);
+    else                            Status = EFI_INVALID_PARAMETER;
+
+    if (EFI_ERROR(Status)) {
+      if (Status == EFI_CRC_ERROR)              MsgPrint(L"Line %u: checksum error\n", St->Line);
+      else if (Status == EFI_INVALID_PARAMETER) MsgPrint(L"Line %u: bad record\n", St->Line);
+      break;
+    }
+  }
+
+  ShellCloseFile(&Lr->Fh);
+  FreePool(Lr);
+  return Status;
+}
+
+// =======================================================
+//        Provisioning manifest (sorted binary index)
+// =======================================================
+//
+// Layout (little endian):
+//   MANIFEST_HEADER
+//   fence table   keys of records 0, S, 2S, ... (S = FenceStride), optional
+//   records       Count x RecordSize bytes, sorted by key (memcmp order)
+//
+// A record is Key[KeySize] (zero padded) followed by write entries
+// { Bank, Off, Len, Data[Len] }, terminated by Len == 0 or the record end.
+//
+// Lookup reads the header and the fence table once, finds the block in
+// memory, then binary-searches the block reading one key per probe:
+// 2 + log2(S) small reads for any manifest size.
+
+#define MANIFEST_SIGNATURE      SIGNATURE_32('E', 'E', 'M', 'F')
+#define MANIFEST_KEY_MAX        64
+#define MANIFEST_RECORD_MAX     4096
+#define MANIFEST_FENCE_MAX      SIZE_1MB     // bytes of fence table loaded
+
+typedef struct {
+  UINT32 Signature;
+  UINT16 Version;         // 1
+  UINT16 KeySize;
+  UINT32 RecordSize;      // key + entries
+  UINT32 Count;
+  UINT32 RecordOffset;
+  UINT32 FenceStride;     // 0: no fence table
+  UINT32 FenceOffset;
+} MANIFEST_HEADER;
+
+STATIC
+EFI_STATUS
+ManifestReadAt (
+  IN     SHELL_FILE_HANDLE Fh,
+  IN     UINT64            Off,
+  OUT    VOID              *Buf,
+  IN     UINTN             Len,
+  IN OUT UINTN             *Reads
+  )
+{
+  EFI_STATUS Status;
+  UINTN      n = Len;
+
+  Status = ShellSetFilePosition(Fh, Off);
+  if (!EFI_ERROR(Status)) Status = ShellReadFile(Fh, &n, Buf);
+  (*Reads)++;
+  if (EFI_ERROR(Status)) return Status;
+  return (n == Len) ? EFI_SUCCESS : EFI_VOLUME_CORRUPTED;
+}
+
+// Find Key (already zero padded to the manifest key size); the caller
+// frees *Record
+STATIC
+EFI_STATUS
+ManifestLookup (
+  IN  CONST CHAR16    *Path,
+  IN  CONST UINT8     *Key,
+  IN  UINTN           KeyLen,
+  OUT MANIFEST_HEADER *Hdr,
+  OUT UINT8           **Record,
+  OUT UINTN           *Reads
+  )
+{
+  EFI_STATUS        Status;
+  SHELL_FILE_HANDLE Fh;
+  UINT8             Probe[MANIFEST_KEY_MAX];
+  UINT8             Padded[MANIFEST_KEY_MAX];
+  UINT8             *Fence = NULL;
+  UINTN             Lo, Hi;
+  INTN              Cmp;
+
+  *Record = NULL;
+  *Reads  = 0;
+
+  Status = ShellOpenFileByName(Path, &Fh, EFI_FILE_MODE_READ, 0);
+  if (EFI_ERROR(Status)) return Status;
+
+  Status = ManifestReadAt(Fh, 0, Hdr, sizeof(*Hdr), Reads);
+  if (EFI_ERROR(Status)) goto Exit;
+  if (Hdr->Signature != MANIFEST_SIGNATURE || Hdr->Version != 1 ||
+      Hdr->KeySize == 0 || Hdr->KeySize > MANIFEST_KEY_MAX ||
+      Hdr->RecordSize <= Hdr->KeySize || Hdr->RecordSize > MANIFEST_RECORD_MAX) {
+    Hdr->Count = 0;
+    Status     = EFI_VOLUME_CORRUPTED;
+    goto Exit;
+  }
+  if (KeyLen > Hdr->KeySize) {
+    Status = EFI_NOT_FOUND;
+    goto Exit;
+  }
+
+  SetMem(Padded, sizeof(Padded), 0);
+  CopyMem(Padded, Key, KeyLen);
+
+  Lo = 0;
+  Hi = Hdr->Count;
+
+  // Fence table: narrow [Lo, Hi) to one block in memory
+  if (Hdr->FenceStride != 0 && Hdr->Count != 0) {
+    UINTN Fences = (Hdr->Count + Hdr->FenceStride - 1) / Hdr->FenceStride;
+    UINTN Size   = Fences * Hdr->KeySize;
+
+    if (Size <= MANIFEST_FENCE_MAX && (Fence = AllocatePool(Size)) != NULL) {
+      UINTN a = 0, b = Fences;
+
+      Status = ManifestReadAt(Fh, Hdr->FenceOffset, Fence, Size, Reads);
+      if (EFI_ERROR(Status)) goto Exit;
+
+      // last fence <= key
+      while (a < b) {
+        UINTN m = (a + b) / 2;
+        if (CompareMem(&Fence[m * Hdr->KeySize], Padded, Hdr->KeySize) <= 0) a = m + 1;
+        else b = m;
+      }
+      if (a == 0) {
+        Status = EFI_NOT_FOUND;
+        goto Exit;
+      }
+      Lo = (a - 1) * Hdr->FenceStride;
+      Hi = MIN(Lo + Hdr->FenceStride, (UINTN)Hdr->Count);
+    }
+  }
+
+  Status = EFI_NOT_FOUND;
+  while (Lo < Hi) {
+    UINTN  Mid = (Lo + Hi) / 2;
+    UINT64 Off = Hdr->RecordOffset + (UINT64)Mid * Hdr->RecordSize;
+
+    Status = ManifestReadAt(Fh, Off, Probe, Hdr->KeySize, Reads);
+    if (EFI_ERROR(Status)) goto Exit;
+
+    Cmp = CompareMem(Probe, Padded, Hdr->KeySize);
+    if (Cmp == 0) {
+      *Record = AllocatePool(Hdr->RecordSize);
+      if (*Record == NULL) {
+        Status = EFI_OUT_OF_RESOURCES;
+        goto Exit;
+      }
+      Status = ManifestReadAt(Fh, Off, *Record, Hdr->RecordSize, Reads);
+      if (EFI_ERROR(Status)) {
+        FreePool(*Record);
+        *Record = NULL;
+      }
+      goto Exit;
+    }
+    if (Cmp < 0) Lo = Mid + 1;
+    else Hi = Mid;
+    Status = EFI_NOT_FOUND;
+  }
+
+Exit:
+  if (Fence != NULL) FreePool(Fence);
+  ShellCloseFile(&Fh);
+  return Status;
+}
+
+// Record entries -> P; the whole record is checked before anything is set
+STATIC
+EFI_STATUS
+ManifestRecordToPlan (
+  IN  CONST MANIFEST_HEADER *Hdr,
+  IN  CONST UINT8           *Record,
+  OUT EEPROM_PLAN           *P
+  )
+{
+  for (UINTN Pass = 0; Pass < 2; Pass++) {
+    UINTN i = Hdr->KeySize;
+
+    if (Pass == 1) PlanClear(P);
+    while (i + 3 <= Hdr->RecordSize && Record[i + 2] != 0) {
+      UINT8 Bank = Record[i], Off = Record[i + 1], Len = Record[i + 2];
+
+      if (Bank > EEPROM_BANK_MAX || (UINTN)Off + Len > 256 || i + 3 + Len > Hdr->RecordSize) {
+        return EFI_VOLUME_CORRUPTED;
+      }
+      if (Pass == 1) {
+        for (UINTN k = 0; k < Len; k++) PlanSet(P, Bank, Off + k, Record[i + 3 + k]);
+      }
+      i += 3 + Len;
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+// SMBIOS Type 1 serial number, trailing blanks removed
+STATIC
+EFI_STATUS
+SmbiosSystemSerial (
+  OUT UINT8 *Key,
+  IN  UINTN Max,
+  OUT UINTN *Len
+  )
+{
+  UINT8  *p = NULL, *End;
+  UINT64 Addr = 0;
+  UINTN  Size = 0;
+
+  for (UINTN i = 0; i < gST->NumberOfTableEntries; i++) {
+    EFI_CONFIGURATION_TABLE *T  = &gST->ConfigurationTable[i];
+    UINT8                   *Ep = T->VendorTable;
+
+    if (CompareGuid(&T->VendorGuid, &gEfiSmbios3TableGuid)) {
+      Size = *(UINT32 *)&Ep[0x0C];
+      Addr = *(UINT64 *)&Ep[0x10];
+      break;
+    }
+    if (CompareGuid(&T->VendorGuid, &gEfiSmbiosTableGuid) && Addr == 0) {
+      Size = *(UINT16 *)&Ep[0x16];
+      Addr = *(UINT32 *)&Ep[0x18];
+    }
+  }
+  if (Addr == 0 || Size == 0) return EFI_NOT_FOUND;
+
+  p   = (UINT8 *)(UINTN)Addr;
+  End = p + Size;
+  while (p + 4 <= End && p[0] != 127) {
+    UINT8 *Str = p + p[1];
+    UINT8 *Next;
+
+    // Skip the formatted part and the string set (ends with a double NUL)
+    for (Next = Str; Next + 1 < End && (Next[0] != 0 || Next[1] != 0); Next++);
+    Next += 2;
+
+    if (p[0] == 1 && p[1] > 7 && p[7] != 0) {
+      UINTN Index = p[7];
+      while (--Index > 0 && Str < Next) Str += AsciiStrLen((CHAR8 *)Str) + 1;
+      if (Str >= Next || *Str == 0) return EFI_NOT_FOUND;
+
+      *Len = AsciiStrLen((CHAR8 *)Str);
+      while (*Len > 0 && Str[*Len - 1] == ' ') (*Len)--;
+      if (*Len > Max) return EFI_BUFFER_TOO_SMALL;
+      CopyMem(Key, Str, *Len);
+      return EFI_SUCCESS;
+    }
+    p = Next;
+  }
+  return EFI_NOT_FOUND;
+}
+
+// =======================================================
+//          Multiple ECs (interleaved plan execution)
+// =======================================================
+//
+// Each EC context carries its own profile and walks its own plan byte by
+// byte: select bank, read (write elision), write, read back. The backend
+// code works on mEc, so a turn loads the context into mEc and saves it
+// back. An Index I/O command is started and left running: while its
+// Start bit is pending the loop serves the next EC, so the total time
+// tends to the slowest EC instead of the sum. PortIO transactions are
+// short handshakes and run whole within one turn. The cache (mCache) is
+// bypassed and invalidated afterwards.
+
+#define EC_CTX_MAX              4
+#define EC_CTX_MISMATCH_KEEP    8
+#define EC_CTX_OP_TIMEOUT_US    500000
+#define EC_CTX_IDLE_US          10    // every EC busy: poll again after this
+
+typedef enum {
+  CTX_OP_BANK = 0,
+  CTX_OP_READ,          // elision: current value
+  CTX_OP_WRITE,
+  CTX_OP_VERIFY,        // read back
+  CTX_OP_DONE
+} CTX_OP;
+
+typedef struct {
+  EC_PROFILE   Prof;
+  CONST CHAR16 *Name;         // as given on the command line
+  EEPROM_PLAN  *Plan;
+  UINT8        Op;            // CTX_OP
+  BOOLEAN      Pending;       // Index I/O command started, Start not cleared yet
+  UINT8        Val;           // read result
+  INTN         BankSel;
+  UINTN        Bank;
+  UINTN        Off;
+  UINT64       OpStartUs;
+  UINT64       BusyUs;        // sum of op latencies: this EC's time when run alone
+  UINT64       DoneUs;
+  EFI_STATUS   Status;
+  PLAN_STATS   St;
+  struct {                    // first EC_CTX_MISMATCH_KEEP verify failures, reported afterwards
+    UINT8 Bank, Off, Expect, Read;
+  } Mis[EC_CTX_MISMATCH_KEEP];
+} EC_CTX;
+
+STATIC
+BOOLEAN
+AccessFromName (
+  IN  CONST CHAR16   *Name,
+  OUT EC_ACCESS_TYPE *Type
+  )
+{
+  if (StriCmp(Name, L"portio") == 0)       *Type = ACCESS_PORTIO;
+  else if (StriCmp(Name, L"ene") == 0)     *Type = ACCESS_INDEXIO_ENE;
+  else if (StriCmp(Name, L"nuvoton") == 0) *Type = ACCESS_INDEXIO_NUVOTON;
+  else if (StriCmp(Name, L"ite") == 0)     *Type = ACCESS_INDEXIO_ITE;
+  else return FALSE;
+  return TRUE;
+}
+
+// "<access>[:<hex base>]" or "portio:62|60" -> Ctx->Prof (mEc is left as it was)
+STATIC
+BOOLEAN
+EcCtxParse (
+  IN  CONST CHAR16 *Spec,
+  OUT EC_CTX       *Ctx
+  )
+{
+  CHAR16     Name[16];
+  EC_PROFILE Saved;
+  UINTN      n;
+  BOOLEAN    Ok = TRUE;
+
+  for (n = 0; Spec[n] != 0 && Spec[n] != L':'; n++) {
+    if (n + 1 >= ARRAY_SIZE(Name)) return FALSE;
+    Name[n] = Spec[n];
+  }
+  Name[n] = 0;
+
+  CopyMem(&Saved, &mEc, sizeof(mEc));
+  if (!AccessFromName(Name, &mEc.AccessType)) {
+    Ok = FALSE;
+  } else {
+    ApplyProfileForAccess();
+    if (mEc.AccessType == ACCESS_PORTIO) {
+      mEc.PortMode = PORTMODE_ACPI_62_66;
+      if (Spec[n] == L':' && StrCmp(&Spec[n + 1], L"60") == 0) mEc.PortMode = PORTMODE_8042_60_64;
+      else if (Spec[n] == L':' && StrCmp(&Spec[n + 1], L"62") != 0) Ok = FALSE;
+    } else if (Spec[n] == L':') {
+      UINTN Base = StrHexToUintn(&Spec[n + 1]);
+      if (Base == 0 || Base > 0xFFFC) Ok = FALSE;
+      mEc.IndexIoBase = (UINT16)Base;
+    }
+  }
+
+  SetMem(Ctx, sizeof(*Ctx), 0);
+  CopyMem(&Ctx->Prof, &mEc, sizeof(mEc));
+  CopyMem(&mEc, &Saved, sizeof(mEc));
+  Ctx->Name = Spec;
+  return Ok;
+}
+
+// Do A and B drive the same I/O ports (i.e. possibly the same EC)? Two
+// contexts on one EC would each believe their own bank is selected.
+STATIC
+BOOLEAN
+EcCtxOverlap (
+  IN CONST EC_CTX *A,
+  IN CONST EC_CTX *B
+  )
+{
+  CONST EC_PROFILE *Pa = &A->Prof;
+  CONST EC_PROFILE *Pb = &B->Prof;
+
+  if ((Pa->AccessType == ACCESS_PORTIO) != (Pb->AccessType == ACCESS_PORTIO)) return FALSE;
+  if (Pa->AccessType == ACCESS_PORTIO) return (BOOLEAN)(Pa->PortMode == Pb->PortMode);
+
+  // Index windows are Base+0..Base+3 for every profile
+  return (BOOLEAN)(Pa->IndexIoBase <= Pb->IndexIoBase + 3 && Pb->IndexIoBase <= Pa->IndexIoBase + 3);
+}
+
+// Are Ctx's ports forwarded by the LPC/eSPI bridge?
+STATIC
+BOOLEAN
+EcCtxRouted (
+  IN CONST EC_CTX *Ctx
+  )
+{
+  EC_PROFILE Saved;
+  BOOLEAN    Routed;
+
+  CopyMem(&Saved, &mEc, sizeof(mEc));
+  CopyMem(&mEc, &Ctx->Prof, sizeof(mEc));
+  Routed = DecodeBackendRouted();
+  CopyMem(&mEc, &Saved, sizeof(mEc));
+  return Routed;
+}
+
+// Move to the next planned byte at or after (Bank, Off); CTX_OP_DONE if none
+STATIC
+VOID
+EcCtxSeek (
+  IN OUT EC_CTX *Ctx
+  )
+{
+  UINTN Len;
+
+  for (; Ctx->Bank <= EEPROM_BANK_MAX; Ctx->Bank++, Ctx->Off = 0) {
+    if (Ctx->Off < 256 && PlanNextRun(Ctx->Plan, Ctx->Bank, &Ctx->Off, &Len)) {
+      Ctx->Op = ((INTN)Ctx->Bank == Ctx->BankSel) ? CTX_OP_READ : CTX_OP_BANK;
+      return;
+    }
+  }
+  Ctx->Op = CTX_OP_DONE;
+}
+
+STATIC
+VOID
+EcCtxFinish (
+  IN OUT EC_CTX     *Ctx,
+  IN     EFI_STATUS Status
+  )
+{
+  Ctx->Status  = Status;
+  Ctx->Op      = CTX_OP_DONE;
+  Ctx->Pending = FALSE;
+  Ctx->DoneUs  = NowUs();
+}
+
+// The current op finished (Val holds read data): pick the next one
+STATIC
+VOID
+EcCtxComplete (
+  IN OUT EC_CTX *Ctx
+  )
+{
+  UINT8 Want = Ctx->Plan->Data[Ctx->Bank][Ctx->Off];
+
+  Ctx->BusyUs += NowUs() - Ctx->OpStartUs;
+
+  switch (Ctx->Op) {
+  case CTX_OP_BANK:
+    Ctx->BankSel = (INTN)Ctx->Bank;
+    Ctx->Op      = CTX_OP_READ;
+    return;
+
+  case CTX_OP_READ:
+    if (Ctx->Val != Want) {
+      Ctx->Op = CTX_OP_WRITE;
+      return;
+    }
+    Ctx->St.Skipped++;
+    break;
+
+  case CTX_OP_WRITE:
+    Ctx->St.Bytes++;
+    Ctx->St.Cycles++;
+    Ctx->Op = CTX_OP_VERIFY;
+    return;
+
+  default:   // CTX_OP_VERIFY
+    if (Ctx->Val != Want) {
+      // No Print here: console output would stall the other ECs and skew the times
+      if (Ctx->St.Mismatch < EC_CTX_MISMATCH_KEEP) {
+        Ctx->Mis[Ctx->St.Mismatch].Bank   = (UINT8)Ctx->Bank;
+        Ctx->Mis[Ctx->St.Mismatch].Off    = (UINT8)Ctx->Off;
+        Ctx->Mis[Ctx->St.Mismatch].Expect = Want;
+        Ctx->Mis[Ctx->St.Mismatch].Read   = Ctx->Val;
+      }
+      Ctx->St.Mismatch++;
+    }
+    break;
+  }
+
+  Ctx->Off++;
+  EcCtxSeek(Ctx);
+  if (Ctx->Op == CTX_OP_DONE) {
+    EcCtxFinish(Ctx, (Ctx->St.Mismatch != 0) ? EFI_DEVICE_ERROR : EFI_SUCCESS);
+  }
+}
+
+// Issue Ctx->Op. Index I/O: leaves it pending. PortIO: runs it to the end.
+STATIC
+EFI_STATUS
+EcCtxStart (
+  IN OUT EC_CTX *Ctx
+  )
+{
+  EFI_STATUS Status;
+  UINT8      Want = Ctx->Plan->Data[Ctx->Bank][Ctx->Off];
+
+  Ctx->OpStartUs = NowUs();
+
+  if (mEc.AccessType == ACCESS_PORTIO) {
+    if (Ctx->Op == CTX_OP_BANK)       Status = EcSetBank((UINT8)Ctx->Bank);
+    else if (Ctx->Op == CTX_OP_WRITE) Status = EcWriteEeprom8((UINT8)Ctx->Off, Want);
+    else                              Status = EcReadEeprom8((UINT8)Ctx->Off, &Ctx->Val);
+    return Status;
+  }
+
+  if (Ctx->Op == CTX_OP_BANK) {
+    Status = IndexMailboxStart(EC_CMD_EEPROM_BANK_NUM, (UINT8)Ctx->Bank, 0, FALSE);
+  } else if (Ctx->Op == CTX_OP_WRITE) {
+    Status = IndexMailboxStart(EC_CMD_EEPROM_WRITE, (UINT8)Ctx->Off, Want, TRUE);
+  } else {
+    Status = IndexMailboxStart(EC_CMD_EEPROM_READ, (UINT8)Ctx->Off, 0, FALSE);
+  }
+  Ctx->Pending = (BOOLEAN)!EFI_ERROR(Status);
+  return Status;
+}
+
+// One turn of one EC (loaded in mEc). FALSE: nothing happened, it is busy.
+STATIC
+BOOLEAN
+EcCtxTurn (
+  IN OUT EC_CTX *Ctx
+  )
+{
+  EFI_STATUS Status;
+
+  if (Ctx->Op == CTX_OP_DONE) return FALSE;
+
+  if (Ctx->Pending) {
+    Status = IndexMailboxPoll();
+    if (Status == EFI_NOT_READY) {
+      if (NowUs() - Ctx->OpStartUs < EC_CTX_OP_TIMEOUT_US) return FALSE;
+      LogEvent(LOG_ERROR, LOG_INDEX_TIMEOUT, mEc.CmdCntl, IndexIoRead8(mEc.CmdCntl),
+               CMD_CNTL_START, 0, mEc.IndexIoBase);
+      EcCtxFinish(Ctx, EFI_TIMEOUT);
+      return TRUE;
+    }
+    Ctx->Pending = FALSE;
+    if (Ctx->Op == CTX_OP_READ || Ctx->Op == CTX_OP_VERIFY) Ctx->Val = IndexIoRead8(mEc.CmdReturnDataBuffer);
+    EcCtxComplete(Ctx);
+    if (Ctx->Op == CTX_OP_DONE) return TRUE;
+  }
+
+  // Start the next command right away so it runs while the others are served
+  Status = EcCtxStart(Ctx);
+  if (EFI_ERROR(Status)) EcCtxFinish(Ctx, Status);
+  else if (!Ctx->Pending) EcCtxComplete(Ctx);
+  return TRUE;
+}
+
+// Run every context's plan to completion, interleaved. Returns the first
+// failure; per-EC results are in Ctx[i].Status / St / BusyUs / DoneUs.
+STATIC
+EFI_STATUS
+EcCtxExecute (
+  IN OUT EC_CTX *Ctx,
+  IN     UINTN  Count
+  )
+{
+  EFI_STATUS Status = EFI_SUCCESS;
+  EC_PROFILE Saved;
+  UINTN      Active;
+
+  CopyMem(&Saved, &mEc, sizeof(mEc));
+
+  for (UINTN i = 0; i < Count; i++) {
+    Ctx[i].BankSel = -1;
+    Ctx[i].Status  = EFI_SUCCESS;
+    EcCtxSeek(&Ctx[i]);
+    if (Ctx[i].Op == CTX_OP_DONE) Ctx[i].DoneUs = NowUs();
+    for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) {
+      if (PlanBankUsed(Ctx[i].Plan, b)) Ctx[i].St.Banks++;
+    }
+  }
+
+  do {
+    BOOLEAN Progress = FALSE;
+
+    Active = 0;
+    for (UINTN i = 0; i < Count; i++) {
+      if (Ctx[i].Op == CTX_OP_DONE) continue;
+      Active++;
+      CopyMem(&mEc, &Ctx[i].Prof, sizeof(mEc));
+      if (EcCtxTurn(&Ctx[i])) Progress = TRUE;
+      CopyMem(&Ctx[i].Prof, &mEc, sizeof(mEc));
+    }
+    if (Active != 0 && !Progress) gBS->Stall(EC_CTX_IDLE_US);
+  } while (Active != 0);
+
+  CopyMem(&mEc, &Saved, sizeof(mEc));
+  CacheInvalidateAll();       // the primary EC may be one of them
+
+  for (UINTN i = 0; i < Count; i++) {
+    if (EFI_ERROR(Ctx[i].Status) && !EFI_ERROR(Status)) Status = Ctx[i].Status;
+  }
+  return Status;
+}
+
+// =======================================================
+//           Shared command bodies (CLI args / UI prompts)
+// =======================================================
+//
+// Commands take ASCII tokens so the CLI (CHAR16 argv, narrowed) and the
+// interactive prompts (typed line, tokenized) share one parser.
+
+#define CMD_TOKEN_MAX           8
+#define CMD_LINE_MAX            160
 
-  Print(L"%02x | ", (UINTN)base);
+// Hex byte string "DEADBEEF" -> bytes, in typed order
+STATIC
+BOOLEAN
+AsciiParseHexBytes (
+  IN  CONST CHAR8 *Tok,
+  OUT UINT8       *Out,
+  IN  UINTN       Max,
+  OUT UINTN       *Len
+  )
+{
+  UINTN n = 0;
+  UINT8 Hi, Lo;
 
-  if (mDispMode == DISP_BYTE) {
-    for (UINTN i = 0; i < COLS; i++) {
-      UINTN idx = base + i;
-      if (idx == mCursor) {
-        AttrCursorBlueBg();
-        Print(L" %02x ", (UINTN)mDump[idx]);
-        AttrDefault();
-      } else {
-        Print(L" %02x ", (UINTN)mDump[idx]);
+  if (Tok[0] == '0' && (Tok[1] == 'x' || Tok[1] == 'X')) Tok += 2;
+
+  while (Tok[0] != 0) {
+    if (Tok[1] == 0 || n == Max) return FALSE;
+    if (!HexCharToNibble((CHAR16)Tok[0], &Hi) || !HexCharToNibble((CHAR16)Tok[1], &Lo)) return FALSE;
+    Out[n++] = (UINT8)((Hi << 4) | Lo);
+    Tok += 2;
+  }
+
+  *Len = n;
+  return (BOOLEAN)(n > 0);
+}
+
+// fill <bank>:<off> <len> <pattern>
+STATIC
+EFI_STATUS
+CmdFill (
+  IN UINTN n,
+  IN CHAR8 **Tok
+  )
+{
+  EFI_STATUS Status;
+  PLAN_STATS St;
+  UINT8      Bank, Off, Pat[32];
+  UINTN      Len, PatLen;
+
+  if (n != 3 || !AsciiParseBankOff(Tok[0], &Bank, &Off) ||
+      !AsciiParseHex(Tok[1], 0x100, &Len) || Len == 0 ||
+      !AsciiParseHexBytes(Tok[2], Pat, sizeof(Pat), &PatLen)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  SetMem(&St, sizeof(St), 0);
+  Status = BulkFill(Bank, Off, Len, Pat, PatLen, &St);
+  BulkReport(L"fill", Status, &St);
+  return Status;
+}
+
+// copy <srcbank>:<off> <dstbank>:<off> <len>
+STATIC
+EFI_STATUS
+CmdCopy (
+  IN UINTN n,
+  IN CHAR8 **Tok
+  )
+{
+  EFI_STATUS Status;
+  PLAN_STATS St;
+  UINT8      SrcBank, SrcOff, DstBank, DstOff;
+  UINTN      Len;
+
+  if (n != 3 || !AsciiParseBankOff(Tok[0], &SrcBank, &SrcOff) ||
+      !AsciiParseBankOff(Tok[1], &DstBank, &DstOff) ||
+      !AsciiParseHex(Tok[2], 0x100, &Len) || Len == 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  SetMem(&St, sizeof(St), 0);
+  Status = BulkCopy(SrcBank, SrcOff, DstBank, DstOff, Len, &St);
+  BulkReport(L"copy", Status, &St);
+  return Status;
+}
+
+#ifndef EEPROMEC_CLI_ONLY
+// diff <id> <id> | revert <id>   (snapshot ids are hex, as listed)
+STATIC
+EFI_STATUS
+CmdSnap (
+  IN UINTN n,
+  IN CHAR8 **Tok
+  )
+{
+  EFI_STATUS Status;
+  PLAN_STATS St;
+  UINTN      IdA, IdB;
+
+  if (n == 3 && AsciiStrCmp(Tok[0], "diff") == 0 &&
+      AsciiParseHex(Tok[1], MAX_UINT32, &IdA) && AsciiParseHex(Tok[2], MAX_UINT32, &IdB)) {
+    Status = SnapDiff((UINT32)IdA, (UINT32)IdB);
+    if (Status == EFI_NOT_FOUND) Print(L"No such snapshot.\n");
+    if (Status == EFI_INVALID_PARAMETER) Print(L"Snapshots are from different banks.\n");
+    return (Status == EFI_INVALID_PARAMETER) ? EFI_UNSUPPORTED : Status;
+  }
+
+  if (n == 2 && AsciiStrCmp(Tok[0], "revert") == 0 && AsciiParseHex(Tok[1], MAX_UINT32, &IdA)) {
+    SetMem(&St, sizeof(St), 0);
+    Status = SnapRevert((UINT32)IdA, &St);
+    if (Status == EFI_NOT_FOUND) Print(L"No such snapshot.\n");
+    else BulkReport(L"revert", Status, &St);
+    return Status;
+  }
+
+  return EFI_INVALID_PARAMETER;
+}
+#endif // EEPROMEC_CLI_ONLY
+
+// =======================================================
+//                  Command line (non-interactive)
+// =======================================================
+//
+//   EEPROMECTool.efi [-a portio|ene|nuvoton|ite] [-p 62|60] [-pw <cmd> <pagesize>] [-pwbuf <lenbuf> <databuf>]
+//                    [-vote on|off] [-decode on|off] [-lat on|off] [-j <file|->] [-l <logfile>] [<command> [args]]
+//
+// -j writes JSON Lines events to <file> ("-": stdout) instead of the
+// human-readable output, see "Structured output" above.
+//
+// -l writes the event log (see "Event log") to <logfile>, in the UI too.
+//
+// -vote on rereads suspect bytes (slow, retried, or not matching the cache)
+// and keeps the majority value, see EcReadVoted.
+//
+// -pw enables EEPROM page writes with the given opcode and page size (hex)
+// for EC firmware that supports them; writes are split on page boundaries.
+//
+// Without a command the interactive editor starts, with the options applied
+// (EEPROMEC_CLI_ONLY builds print the usage instead).
+
+typedef
+EFI_STATUS
+(*CLI_HANDLER) (
+  IN UINTN  Argc,
+  IN CHAR16 **Argv
+  );
+
+typedef struct {
+  CONST CHAR16 *Name;
+  CONST CHAR16 *Usage;
+  CLI_HANDLER  Handler;
+} CLI_COMMAND;
+
+// run [-n|-r] <script>
+STATIC
+EFI_STATUS
+CliRun (
+  IN UINTN  Argc,
+  IN CHAR16 **Argv
+  )
+{
+  if (Argc == 2) return ScriptRunFile(Argv[1], FALSE, FALSE);
+  if (Argc == 3 && StrCmp(Argv[1], L"-n") == 0) return ScriptRunFile(Argv[2], TRUE, FALSE);
+  if (Argc == 3 && StrCmp(Argv[1], L"-r") == 0) return ScriptRunFile(Argv[2], FALSE, TRUE);
+  return EFI_INVALID_PARAMETER;
+}
+
+// multi [-n] <ec> <file> [<ec> <file> ...]   one image per EC, written interleaved
+STATIC
+EFI_STATUS
+CliMulti (
+  IN UINTN  Argc,
+  IN CHAR16 **Argv
+  )
+{
+  EFI_STATUS   Status = EFI_SUCCESS;
+  EC_CTX       *Ctx;
+  IMPORT_STATS Ist;
+  BOOLEAN      DryRun = FALSE;
+  UINTN        First  = 1;
+  UINTN        Count;
+  UINT64       T0, Wall, Sum = 0;
+
+  if (Argc >= 2 && StrCmp(Argv[1], L"-n") == 0) {
+    DryRun = TRUE;
+    First  = 2;
+  }
+  if (Argc < First + 2 || (Argc - First) % 2 != 0 || (Argc - First) / 2 > EC_CTX_MAX) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Count = (Argc - First) / 2;
+
+  Ctx = AllocateZeroPool(Count * sizeof(EC_CTX));
+  if (Ctx == NULL) return EFI_OUT_OF_RESOURCES;
+
+  for (UINTN i = 0; i < Count && !EFI_ERROR(Status); i++) {
+    CONST CHAR16 *Path = Argv[First + 2 * i + 1];
+
+    if (!EcCtxParse(Argv[First + 2 * i], &Ctx[i])) {
+      Status = EFI_INVALID_PARAMETER;
+      break;
+    }
+    if (!EcCtxRouted(&Ctx[i])) {
+      MsgPrint(L"%s: not decoded by the LPC/eSPI bridge\n", Ctx[i].Name);
+      Status = EFI_NO_MAPPING;
+      break;
+    }
+    for (UINTN j = 0; j < i; j++) {
+      if (EcCtxOverlap(&Ctx[j], &Ctx[i])) {
+        MsgPrint(L"%s and %s use the same I/O ports (same EC?)\n", Ctx[j].Name, Ctx[i].Name);
+        Status = EFI_INVALID_PARAMETER;
+        break;
       }
     }
-  } else if (mDispMode == DISP_WORD) {
-    for (UINTN i = 0; i < COLS; i += 2) {
-      UINTN idx = base + i;
-      UINT16 v  = ReadU16LE(idx);
-      if (mCursor == idx || mCursor == idx + 1) {
-        AttrCursorBlueBg();
-        Print(L" %04x  ", (UINTN)v);
-        AttrDefault();
-      } else {
-        Print(L" %04x  ", (UINTN)v);
+    if (EFI_ERROR(Status)) break;
+    Ctx[i].Plan = AllocatePool(sizeof(EEPROM_PLAN));
+    if (Ctx[i].Plan == NULL) {
+      Status = EFI_OUT_OF_RESOURCES;
+      break;
+    }
+
+    Status = ImportParseFile(Path, Ctx[i].Plan, &Ist);
+    if (EFI_ERROR(Status)) {
+      if (mJson) EvError(L"multi", Ist.Line, Status);
+      else Print(L"multi %s: %r, nothing written\n", Path, Status);
+      if (Status == EFI_INVALID_PARAMETER) Status = EFI_COMPROMISED_DATA;
+      break;
+    }
+    MsgPrint(L"%s: %s, %u records, %u bytes (%u unique)\n",
+             Ctx[i].Name, Path, Ist.Records, Ist.Bytes, PlanCount(Ctx[i].Plan));
+  }
+
+  if (!EFI_ERROR(Status) && !DryRun) {
+    T0     = NowUs();
+    Status = EcCtxExecute(Ctx, Count);
+    Wall   = NowUs() - T0;
+
+    for (UINTN i = 0; i < Count; i++) {
+      CONST EC_CTX *C = &Ctx[i];
+
+      Sum += C->BusyUs;
+      for (UINTN m = 0; m < MIN((UINTN)C->St.Mismatch, (UINTN)EC_CTX_MISMATCH_KEEP); m++) {
+        if (mJson) {
+          EvMismatch(C->Mis[m].Bank, C->Mis[m].Off, C->Mis[m].Expect, C->Mis[m].Read);
+        } else {
+          Print(L"%s: verify fail @Bank%u Addr 0x%02x: expect 0x%02x read 0x%02x\n", C->Name,
+                (UINTN)C->Mis[m].Bank, (UINTN)C->Mis[m].Off, (UINTN)C->Mis[m].Expect, (UINTN)C->Mis[m].Read);
+        }
       }
+      if (mJson) {
+        JsonBegin("multi");
+        JsonKeyU("ec", i);
+        JsonKeyS("spec", C->Name);
+        JsonKeyU("bytes", C->St.Bytes);
+        JsonKeyU("skipped", C->St.Skipped);
+        JsonKeyU("mismatch", C->St.Mismatch);
+        JsonKeyU("busy_us", C->BusyUs);
+        JsonKeyU("done_us", C->DoneUs - T0);
+        JsonKeyStatus(C->Status);
+        JsonEnd();
+        continue;
+      }
+      Print(L"%s: wrote %u bytes, skipped %u unchanged, verify mismatches %u, busy %lu us, done at %lu us: %r\n",
+            C->Name, (UINTN)C->St.Bytes, (UINTN)C->St.Skipped, (UINTN)C->St.Mismatch,
+            C->BusyUs, C->DoneUs - T0, C->Status);
+    }
+    MsgPrint(L"multi: %u ECs in %lu us (%lu us one after another)\n", Count, Wall, Sum);
+  }
+
+  for (UINTN i = 0; i < Count; i++) {
+    if (Ctx[i].Plan != NULL) FreePool(Ctx[i].Plan);
+  }
+  FreePool(Ctx);
+  return Status;
+}
+
+#ifdef EEPROMEC_CLI_ONLY
+#define EEPROMEC_VARIANT        L"cli"
+#else
+#define EEPROMEC_VARIANT        L"full"
+#endif
+
+// bench: startup cost of this build. Entry-to-first-transaction includes
+// option parsing and the 10 ms TSC calibration, so run it as the only
+// command; the bank 0 read is that first transaction.
+// bench render [<frames>]: console cost only, see "Render benchmark".
+STATIC
+EFI_STATUS
+CliBench (
+  IN UINTN  Argc,
+  IN CHAR16 **Argv
+  )
+{
+  EFI_STATUS                Status;
+  EFI_LOADED_IMAGE_PROTOCOL *Image;
+  UINT64                    ImageSize = 0;
+  UINT64                    FirstUs   = 0;
+  UINT64                    T0, ReadUs;
+
+  if (Argc >= 2 && StriCmp(Argv[1], L"render") == 0) {
+    if (Argc > 3) return EFI_INVALID_PARAMETER;
+#ifdef EEPROMEC_CLI_ONLY
+    MsgPrint(L"No renderer in this build.\n");
+    return EFI_UNSUPPORTED;
+#else
+    return RenderBench((Argc == 3) ? StrDecimalToUintn(Argv[2]) : RENDER_BENCH_FRAMES);
+#endif
+  }
+  if (Argc != 1) return EFI_INVALID_PARAMETER;
+
+  if (!EFI_ERROR(gBS->HandleProtocol(gImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&Image))) {
+    ImageSize = Image->ImageSize;
+  }
+
+  T0     = NowUs();
+  Status = EcSchedTransfer(EC_PRIO_USER_READ, 0, 0, 256, FALSE, NULL, EC_REQ_FORCE_BANK);
+  ReadUs = NowUs() - T0;
+  if (mFirstXferTsc != 0) FirstUs = DivU64x64Remainder(mFirstXferTsc - mEntryTsc, mTscPerUs, NULL);
+
+  if (mJson) {
+    JsonBegin("bench");
+    JsonKeyS("variant", EEPROMEC_VARIANT);
+    JsonKeyU("image_size", ImageSize);
+    JsonKeyU("first_xfer_us", FirstUs);
+    JsonKeyU("bank_read_us", ReadUs);
+    JsonKeyStatus(Status);
+    JsonEnd();
+    return Status;
+  }
+
+  Print(L"Variant             : %s\n", EEPROMEC_VARIANT);
+  Print(L"Image size          : %lu bytes\n", ImageSize);
+  Print(L"Entry -> first xfer : %lu us\n", FirstUs);
+  Print(L"Bank 0 read (256 B) : %lu us  %r\n", ReadUs, Status);
+  return Status;
+}
+
+// Narrow Argv[1..] to ASCII tokens for the shared Cmd* bodies
+STATIC
+UINTN
+CliAsciiArgs (
+  IN  UINTN  Argc,
+  IN  CHAR16 **Argv,
+  OUT CHAR8  *Buf,
+  IN  UINTN  BufSize,
+  OUT CHAR8  **Tok
+  )
+{
+  UINTN n = 0;
+  UINTN Used = 0;
+
+  for (UINTN i = 1; i < Argc && n < CMD_TOKEN_MAX; i++) {
+    CONST CHAR16 *a = Argv[i];
+    Tok[n++] = &Buf[Used];
+    while (*a != 0 && Used + 1 < BufSize) {
+      Buf[Used++] = (*a <= 0x7E) ? (CHAR8)*a : '?';
+      a++;
+    }
+    if (Used + 1 >= BufSize) return CMD_TOKEN_MAX + 1;
+    Buf[Used++] = 0;
+  }
+  return (Argc - 1 > CMD_TOKEN_MAX) ? CMD_TOKEN_MAX + 1 : n;
+}
+
+// fill <bank>:<off> <len> <pattern>
+STATIC
+EFI_STATUS
+CliFill (
+  IN UINTN  Argc,
+  IN CHAR16 **Argv
+  )
+{
+  CHAR8 Buf[CMD_LINE_MAX];
+  CHAR8 *Tok[CMD_TOKEN_MAX];
+  return CmdFill(CliAsciiArgs(Argc, Argv, Buf, sizeof(Buf), Tok), Tok);
+}
+
+// copy <srcbank>:<off> <dstbank>:<off> <len>
+STATIC
+EFI_STATUS
+CliCopy (
+  IN UINTN  Argc,
+  IN CHAR16 **Argv
+  )
+{
+  CHAR8 Buf[CMD_LINE_MAX];
+  CHAR8 *Tok[CMD_TOKEN_MAX];
+  return CmdCopy(CliAsciiArgs(Argc, Argv, Buf, sizeof(Buf), Tok), Tok);
+}
+
+// import [-n] <file.hex|file.s19>
+STATIC
+EFI_STATUS
+CliImport (
+  IN UINTN  Argc,
+  IN CHAR16 **Argv
+  )
+{
+  EFI_STATUS   Status;
+  IMPORT_STATS Ist;
+  PLAN_STATS   St;
+  BOOLEAN      DryRun = FALSE;
+  UINTN        Banks = 0;
+
+  if (Argc == 3 && StrCmp(Argv[1], L"-n") == 0) DryRun = TRUE;
+  else if (Argc != 2) return EFI_INVALID_PARAMETER;
+
+  Status = ImportParseFile(Argv[Argc - 1], &mPlanBulk, &Ist);
+  if (EFI_ERROR(Status)) {
+    if (mJson) EvError(L"import", Ist.Line, Status);
+    else Print(L"import %s: %r, nothing written\n", Argv[Argc - 1], Status);
+    return (Status == EFI_INVALID_PARAMETER) ? EFI_COMPROMISED_DATA : Status;
+  }
+
+  for (UINTN b = 0; b <= EEPROM_BANK_MAX; b++) {
+    if (PlanBankUsed(&mPlanBulk, b)) Banks++;
+  }
+  MsgPrint(L"import: %u records, %u bytes (%u unique) in %u banks\n",
+           Ist.Records, Ist.Bytes, PlanCount(&mPlanBulk), Banks);
+  if (DryRun) return EFI_SUCCESS;
+
+  SetMem(&St, sizeof(St), 0);
+  Status = PlanExecute(NULL, &mPlanBulk, TRUE, &St);
+  if (!EFI_ERROR(Status)) Status = PlanVerify(&mPlanBulk, &St);
+  BulkReport(L"import", Status, &St);
+  return Status;
+}
+
+// provision [-n] <manifest> <smbios|<bank>:<off>:<len>>
+STATIC
+EFI_STATUS
+CliProvision (
+  IN UINTN  Argc,
+  IN CHAR16 **Argv
+  )
+{
+  EFI_STATUS      Status;
+  MANIFEST_HEADER Hdr;
+  PLAN_STATS      St;
+  UINT8           Key[MANIFEST_KEY_MAX];
+  UINT8           *Record;
+  UINTN           KeyLen, Reads;
+  BOOLEAN         DryRun = FALSE;
+  BOOLEAN         IsText;
+  CHAR16          **Arg = &Argv[1];
+  CHAR16          KeyText[MANIFEST_KEY_MAX * 2 + 1];
+
+  if (Argc == 4 && StrCmp(Argv[1], L"-n") == 0) {
+    DryRun = TRUE;
+    Arg++;
+  } else if (Argc != 3) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  // Key: SMBIOS Type 1 serial, or a field of the live EEPROM
+  if (StriCmp(Arg[1], L"smbios") == 0) {
+    Status = SmbiosSystemSerial(Key, sizeof(Key), &KeyLen);
+  } else {
+    CHAR8 Buf[CMD_LINE_MAX];
+    CHAR8 *Tok[CMD_TOKEN_MAX];
+    CHAR8 *LenTok;
+    UINT8 Bank, Off;
+    UINTN Len;
+
+    if (CliAsciiArgs(2, Arg, Buf, sizeof(Buf), Tok) != 1) return EFI_INVALID_PARAMETER;
+    for (LenTok = Tok[0]; *LenTok != 0 && *LenTok != ':'; LenTok++);
+    if (*LenTok == ':') LenTok++;
+    for (; *LenTok != 0 && *LenTok != ':'; LenTok++);
+    if (*LenTok != ':') return EFI_INVALID_PARAMETER;
+    *LenTok++ = 0;
+    if (!AsciiParseBankOff(Tok[0], &Bank, &Off) || !AsciiParseHex(LenTok, sizeof(Key), &Len) ||
+        Len == 0 || (UINTN)Off + Len > 256) {
+      return EFI_INVALID_PARAMETER;
     }
+
+    Status = EcSchedTransfer(EC_PRIO_USER_READ, Bank, Off, Len, FALSE, NULL, EC_REQ_FORCE_BANK);
+    if (!EFI_ERROR(Status)) CopyMem(Key, &mCache[Bank][Off], Len);
+    KeyLen = Len;
+  }
+  if (EFI_ERROR(Status)) {
+    if (mJson) EvError(L"key", 0, Status);
+    else Print(L"provision: cannot read the key: %r\n", Status);
+    return Status;
+  }
+
+  // Trailing NULs are the same as the manifest's key padding
+  while (KeyLen > 0 && Key[KeyLen - 1] == 0) KeyLen--;
+
+  IsText = TRUE;
+  for (UINTN i = 0; i < KeyLen; i++) {
+    if (!IsPrintableAscii(Key[i])) IsText = FALSE;
+  }
+  for (UINTN i = 0; i < KeyLen; i++) {
+    if (IsText) KeyText[i] = Key[i];
+    else UnicodeSPrint(&KeyText[i * 2], 3 * sizeof(CHAR16), L"%02x", (UINTN)Key[i]);
+  }
+  KeyText[IsText ? KeyLen : KeyLen * 2] = 0;
+
+  SetMem(&Hdr, sizeof(Hdr), 0);
+  Status = ManifestLookup(Arg[0], Key, KeyLen, &Hdr, &Record, &Reads);
+  if (mJson) {
+    JsonBegin("lookup");
+    JsonKeyS("key", KeyText);
+    JsonKeyU("records", Hdr.Count);
+    JsonKeyU("reads", Reads);
+    JsonKeyStatus(Status);
+    JsonEnd();
   } else {
-    for (UINTN i = 0; i < COLS; i += 4) {
-      UINTN idx = base + i;
-      UINT32 v  = ReadU32LE(idx);
-      if (mCursor >= idx && mCursor <= idx + 3) {
-        AttrCursorBlueBg();
-        Print(L" %08x  ", (UINTN)v);
-        AttrDefault();
-      } else {
-        Print(L" %08x  ", (UINTN)v);
-      }
+    Print(L"provision: key \"%s\" -> %r (%u file reads)\n", KeyText, Status, Reads);
+  }
+  if (EFI_ERROR(Status)) return Status;
+
+  Status = ManifestRecordToPlan(&Hdr, Record, &mPlanBulk);
+  FreePool(Record);
+  if (EFI_ERROR(Status)) {
+    if (mJson) EvError(L"record", 0, Status);
+    else Print(L"provision: malformed record, nothing written\n");
+    return Status;
+  }
+
+  MsgPrint(L"provision: %u bytes in the record\n", PlanCount(&mPlanBulk));
+  if (DryRun) return EFI_SUCCESS;
+
+  SetMem(&St, sizeof(St), 0);
+  Status = PlanExecute(NULL, &mPlanBulk, TRUE, &St);
+  if (!EFI_ERROR(Status)) Status = PlanVerify(&mPlanBulk, &St);
+  BulkReport(L"provision", Status, &St);
+  return Status;
+}
+
+// export <bin|ihex|c|hexdump> <file> [all|<bank>|ecram]
+STATIC
+EFI_STATUS
+CliExport (
+  IN UINTN  Argc,
+  IN CHAR16 **Argv
+  )
+{
+  STATIC CONST CHAR16 *FmtName[] = { L"bin", L"ihex", L"c", L"hexdump" };
+  EFI_STATUS Status;
+  UINTN      Fmt, Bank = EEPROM_BANK_MAX + 1, Bytes;
+  BOOLEAN    EcRam = FALSE;
+
+  if (Argc < 3 || Argc > 4) return EFI_INVALID_PARAMETER;
+
+  for (Fmt = 0; Fmt < ARRAY_SIZE(FmtName) && StriCmp(Argv[1], FmtName[Fmt]) != 0; Fmt++);
+  if (Fmt == ARRAY_SIZE(FmtName)) return EFI_INVALID_PARAMETER;
+
+  if (Argc == 4) {
+    if (StriCmp(Argv[3], L"ecram") == 0) EcRam = TRUE;
+    else if (StriCmp(Argv[3], L"all") != 0) {
+      Bank = StrHexToUintn(Argv[3]);
+      if (Argv[3][0] < L'0' || Argv[3][0] > L'9' || Bank > EEPROM_BANK_MAX) return EFI_INVALID_PARAMETER;
     }
   }
 
-  Print(L"  ");
-  for (UINTN i = 0; i < COLS; i++) {
-    UINT8 b = mDump[base + i];
-    Print(L"%c", IsPrintableAscii(b) ? (CHAR16)b : L'.');
+  Status = ExportToFile(Argv[2], (EXPORT_FORMAT)Fmt, EcRam, Bank, &Bytes);
+  if (mJson) {
+    JsonBegin("export");
+    JsonKeyS("format", FmtName[Fmt]);
+    JsonKeyS("file", Argv[2]);
+    JsonKeyU("bytes", Bytes);
+    JsonKeyStatus(Status);
+    JsonEnd();
+  } else {
+    Print(L"export %s: %u bytes to %s: %r\n", FmtName[Fmt], Bytes, Argv[2], Status);
   }
-  Print(L"\n");
+  return Status;
 }
 
+STATIC CONST CLI_COMMAND mCliCommands[] = {
+  { L"run",  L"run [-n|-r] <script>   execute a batch script (-n: show the plan only, -r: resume)", CliRun  },
+  { L"fill", L"fill <bank>:<off> <len> <pattern>   e.g. fill 2:00 100 FF",               CliFill },
+  { L"copy", L"copy <srcbank>:<off> <dstbank>:<off> <len>   e.g. copy 0:00 7:00 100",   CliCopy },
+  { L"import", L"import [-n] <file>   write an Intel HEX / S-record image (-n: parse only)", CliImport },
+  { L"provision", L"provision [-n] <manifest> <smbios|<bank>:<off>:<len>>   apply this unit's manifest record", CliProvision },
+  { L"export", L"export <bin|ihex|c|hexdump> <file> [all|<bank>|ecram]",              CliExport },
+  { L"multi", L"multi [-n] <ec> <file> [<ec> <file> ...]   ec: portio[:62|60], ene|nuvoton|ite[:<base>]", CliMulti },
+  { L"bench", L"bench [render [<frames>]]   startup cost / console render cost",        CliBench },
+};
+
 STATIC
 VOID
-Render (
+CliUsage (
   VOID
   )
 {
-  gST->ConOut->ClearScreen(gST->ConOut);
+  Print(L"Usage: EEPROMECTool [-a portio|ene|nuvoton|ite] [-p 62|60] [-pw <cmd> <pagesize>] [-pwbuf <lenbuf> <databuf>]\n"
+        L"                    [-vote on|off] [-decode on|off] [-lat on|off] [-j <file|->] [-l <logfile>] [<command> [args]]\n");
+  for (UINTN i = 0; i < ARRAY_SIZE(mCliCommands); i++) {
+    Print(L"  %s\n", mCliCommands[i].Usage);
+  }
+}
 
-  PrintHeader();
-  for (UINTN r = 0; r < ROWS; r++) PrintRow(r);
+STATIC
+EFI_STATUS
+CliDispatch (
+  IN UINTN  Argc,
+  IN CHAR16 **Argv
+  )
+{
+  EFI_STATUS Status;
 
-  Print(L"\nKeys: ");
-  PrintParenGreen(L"PgUp/PgDn"); Print(L"=Bank  ");
-  PrintParenGreen(L"TAB");       PrintParenGreen(L"=Mode(BYTE/WORD/DWORD)  ");
-  PrintParenGreen(L"Arrows");    Print(L"=Move  ");
-  PrintParenGreen(L"ENTER");     PrintParenGreen(L"=Write(BYTE/WORD/DWORD)  ");
-  PrintParenGreen(L"R");         Print(L"=Refresh  ");
-  PrintParenGreen(L"I");         Print(L"=Access  ");
-  PrintParenGreen(L"F1");        Print(L"=Port 60/64  ");
-  PrintParenGreen(L"F2");        Print(L"=Port 62/66  ");
-  PrintParenGreen(L"ESC");       Print(L"=Exit\n");
+  for (UINTN i = 0; i < ARRAY_SIZE(mCliCommands); i++) {
+    if (StriCmp(Argv[0], mCliCommands[i].Name) != 0) continue;
+
+    Status = mCliCommands[i].Handler(Argc, Argv);
+    if (Status == EFI_INVALID_PARAMETER) MsgPrint(L"Usage: %s\n", mCliCommands[i].Usage);
+    return Status;
+  }
+
+  MsgPrint(L"Unknown command: %s\n", Argv[0]);
+  CliUsage();
+  return EFI_INVALID_PARAMETER;
+}
+
+// Parse global options, then run the command. *Handled = FALSE: no command,
+// start the interactive UI.
+STATIC
+EFI_STATUS
+CliMain (
+  IN  EFI_HANDLE ImageHandle,
+  OUT BOOLEAN    *Handled
+  )
+{
+  EFI_STATUS                    Status;
+  EFI_SHELL_PARAMETERS_PROTOCOL *Params;
+  UINTN                         Argc;
+  CHAR16                        **Argv;
+  UINTN                         i;
+  UINT64                        T0;
+
+  *Handled = FALSE;
+
+  Status = gBS->HandleProtocol(ImageHandle, &gEfiShellParametersProtocolGuid, (VOID **)&Params);
+  if (EFI_ERROR(Status) || Params->Argc <= 1) return EFI_SUCCESS;
+
+  Argc = Params->Argc;
+  Argv = Params->Argv;
+
+  for (i = 1; i + 1 < Argc && Argv[i][0] == L'-'; i += 2) {
+    if (StriCmp(Argv[i], L"-a") == 0) {
+      if (!AccessFromName(Argv[i + 1], &mEc.AccessType)) break;
+      ApplyProfileForAccess();
+      mAccessGiven = TRUE;
+    } else if (StriCmp(Argv[i], L"-p") == 0) {
+      if (StrCmp(Argv[i + 1], L"62") == 0)      mEc.PortMode = PORTMODE_ACPI_62_66;
+      else if (StrCmp(Argv[i + 1], L"60") == 0) mEc.PortMode = PORTMODE_8042_60_64;
+      else break;
+    } else if (StriCmp(Argv[i], L"-j") == 0) {
+      if (StrCmp(Argv[i + 1], L"-") != 0) {
+        Status = FileCreateEmpty(Argv[i + 1], &mJsonOut.Fh);
+        if (EFI_ERROR(Status)) {
+          Print(L"Cannot open %s: %r\n", Argv[i + 1], Status);
+          *Handled = TRUE;
+          return Status;
+        }
+      }
+      mJson = TRUE;
+    } else if (StriCmp(Argv[i], L"-l") == 0) {
+      Status = FileCreateEmpty(Argv[i + 1], &mLogOut.Fh);
+      if (EFI_ERROR(Status)) {
+        Print(L"Cannot open %s: %r\n", Argv[i + 1], Status);
+        *Handled = TRUE;
+        return Status;
+      }
+    } else if (StriCmp(Argv[i], L"-lat") == 0) {
+      if (StriCmp(Argv[i + 1], L"on") == 0)       { mLatReport = TRUE; LatArm(); }
+      else if (StriCmp(Argv[i + 1], L"off") == 0) mLatReport = FALSE;
+      else break;
+    } else if (StriCmp(Argv[i], L"-decode") == 0) {
+      if (StriCmp(Argv[i + 1], L"on") == 0)       mDecode.Check = TRUE;
+      else if (StriCmp(Argv[i + 1], L"off") == 0) mDecode.Check = FALSE;
+      else break;
+    } else if (StriCmp(Argv[i], L"-vote") == 0) {
+      if (StriCmp(Argv[i + 1], L"on") == 0)       mVote = TRUE;
+      else if (StriCmp(Argv[i + 1], L"off") == 0) mVote = FALSE;
+      else break;
+    } else if (StriCmp(Argv[i], L"-pw") == 0 && i + 2 < Argc) {
+      UINTN Cmd  = StrHexToUintn(Argv[i + 1]);
+      UINTN Size = StrHexToUintn(Argv[i + 2]);
+      // A page that isn't a power of two would let bursts cross real page boundaries
+      if (Cmd == 0 || Cmd > 0xFF || Size < EEPROM_PAGE_MIN || Size > EEPROM_PAGE_MAX ||
+          (Size & (Size - 1)) != 0) {
+        break;
+      }
+      mPageWriteCmd  = (UINT8)Cmd;
+      mPageWriteSize = (UINT8)Size;
+      ApplyProfileForAccess();
+      i++;
+    } else if (StriCmp(Argv[i], L"-pwbuf") == 0 && i + 2 < Argc) {
+      UINTN LenBuf  = StrHexToUintn(Argv[i + 1]);
+      UINTN DataBuf = StrHexToUintn(Argv[i + 2]);
+      if (LenBuf == 0 || LenBuf > 0xFFFF || DataBuf == 0 || DataBuf > 0x10000 - EEPROM_PAGE_MAX ||
+          (LenBuf >= DataBuf && LenBuf < DataBuf + EEPROM_PAGE_MAX)) {
+        break;
+      }
+      mPageLenBuf  = (UINT16)LenBuf;
+      mPageDataBuf = (UINT16)DataBuf;
+      ApplyProfileForAccess();
+      i++;
+    } else {
+      break;
+    }
+  }
+
+  // Options only: start the UI with them (JSON output does not apply there)
+  if (i == Argc) {
+    mJson = FALSE;
+    if (mJsonOut.Fh != NULL) ShellCloseFile(&mJsonOut.Fh);
+    mJsonOut.Fh = NULL;
+    return EFI_SUCCESS;
+  }
+
+  *Handled = TRUE;
+  if (Argv[i][0] == L'-') {
+    mJson = FALSE;
+    CliUsage();
+    return EFI_INVALID_PARAMETER;
+  }
+
+
+  T0     = NowUs();
+  Status = CliDispatch(Argc - i, &Argv[i]);
+
+  if (mVote && !mJson) {
+    MsgPrint(L"Vote: %u of %u bytes read needed votes (+%u reads, %u corrected, %u undecided)\n",
+             (UINTN)mSched.Voted, (UINTN)mSched.Reads, (UINTN)mSched.VoteReads,
+             (UINTN)mSched.VoteFixed, (UINTN)mSched.VoteUndecided);
+  }
+
+  if (mLatReport) {
+    if (mJson) LatJson();
+    else LatPrint();
+  }
+
+  LogDrain();
+  if (mLogOut.Fh != NULL) ShellCloseFile(&mLogOut.Fh);
+
+  if (mJson) {
+    UINT64 Xfer = 0;
+    for (UINTN p = 0; p < EC_PRIO_COUNT; p++) Xfer += mSched.Xfer[p];
+
+    JsonBegin("cost");
+    JsonKeyS("cmd", Argv[i]);
+    JsonKeyU("us", NowUs() - T0);
+    JsonKeyU("xfer", Xfer);
+    JsonKeyU("bank_switches", mSched.BankSwitches);
+    JsonKeyU("write_cycles", mSched.WriteCycles);
+    JsonKeyU("ec_errors", mSched.Errors);
+    if (mVote) {
+      JsonKeyU("reads", mSched.Reads);
+      JsonKeyU("voted", mSched.Voted);
+      JsonKeyU("vote_reads", mSched.VoteReads);
+      JsonKeyU("vote_fixed", mSched.VoteFixed);
+      JsonKeyU("vote_undecided", mSched.VoteUndecided);
+    }
+    JsonKeyStatus(Status);
+    JsonEnd();
+    JsonFlush();
+    if (mJsonOut.Fh != NULL) ShellCloseFile(&mJsonOut.Fh);
+  }
+  return Status;
+}
+
+#ifndef EEPROMEC_CLI_ONLY
+
+// =======================================================
+//                Interactive bulk operations
+// =======================================================
+
+// After a bulk operation: show what the cache now holds for mBank
+STATIC
+VOID
+SyncDumpFromCache (
+  VOID
+  )
+{
+  for (UINTN i = 0; i < 256; i++) {
+    if (CacheIsValid(mBank, (UINT8)i)) mDump[i] = mCache[mBank][i];
+  }
+  SnapTakeAll();
 }
 
-// ---------------- Dump / refresh ----------------
+// F: fill from the cursor; the prompt supplies "<len> <pattern>"
 STATIC
 EFI_STATUS
-RefreshDump (
+UiFillAtCursor (
   VOID
   )
 {
   EFI_STATUS Status;
+  CHAR8      Line[CMD_LINE_MAX];
+  CHAR8      Where[8];
+  CHAR8      *Tok[CMD_TOKEN_MAX];
+  UINTN      n;
 
-  Status = EcSetBank(mBank);
+  Status = ReadLineFromKeyboard(L"Fill from cursor, <len> <pattern> (hex, e.g. 10 FF), ", Line, sizeof(Line));
   if (EFI_ERROR(Status)) return Status;
 
-  for (UINTN i = 0; i < 256; i++) {
-    Status = EcReadEeprom8((UINT8)i, &mDump[i]);
-    if (EFI_ERROR(Status)) return Status;
-  }
-  return EFI_SUCCESS;
+  AsciiSPrint(Where, sizeof(Where), "%x:%x", (UINTN)mBank, (UINTN)mCursor);
+  Tok[0] = Where;
+  n = AsciiTokenize(Line, &Tok[1], CMD_TOKEN_MAX - 1);
+  if (n > CMD_TOKEN_MAX - 1) return EFI_INVALID_PARAMETER;
+
+  Status = CmdFill(n + 1, Tok);
+  SyncDumpFromCache();
+  return Status;
 }
 
-// ---------------- Input hex ----------------
+// C: bank-to-bank copy, the prompt supplies all arguments
 STATIC
-BOOLEAN
-HexCharToNibble (
-  IN  CHAR16 c,
-  OUT UINT8  *n
+EFI_STATUS
+UiCopy (
+  VOID
   )
 {
-  if (!n) return FALSE;
-  if (c >= L'0' && c <= L'9') { *n = (UINT8)(c - L'0'); return TRUE; }
-  if (c >= L'a' && c <= L'f') { *n = (UINT8)(c - L'a' + 10); return TRUE; }
-  if (c >= L'A' && c <= L'F') { *n = (UINT8)(c - L'A' + 10); return TRUE; }
-  return FALSE;
+  EFI_STATUS Status;
+  CHAR8      Line[CMD_LINE_MAX];
+  CHAR8      *Tok[CMD_TOKEN_MAX];
+  UINTN      n;
+
+  Status = ReadLineFromKeyboard(L"Copy <srcbank>:<off> <dstbank>:<off> <len> (hex), ", Line, sizeof(Line));
+  if (EFI_ERROR(Status)) return Status;
+
+  n = AsciiTokenize(Line, Tok, CMD_TOKEN_MAX);
+  if (n > CMD_TOKEN_MAX) return EFI_INVALID_PARAMETER;
+
+  Status = CmdCopy(n, Tok);
+  SyncDumpFromCache();
+  return Status;
 }
 
+// N: list the snapshot history, then diff two snapshots or revert to one
 STATIC
 EFI_STATUS
-ReadHexValueNFromKeyboard (
-  IN  UINTN  HexDigits,     // 2/4/8
-  OUT UINT32 *OutValue
+UiSnapshots (
+  VOID
   )
 {
-  EFI_INPUT_KEY Key;
-  UINT32 v = 0;
-  UINT8  nib;
-
-  if (!OutValue) return EFI_INVALID_PARAMETER;
-  if (HexDigits != 2 && HexDigits != 4 && HexDigits != 8) return EFI_INVALID_PARAMETER;
-
-  Print(L"\nInput %u hex digits, ", (UINTN)HexDigits);
-  PrintParenGreen(L"ESC/ENTER");
-  Print(L" to cancel: ");
+  EFI_STATUS Status;
+  CHAR8      Line[CMD_LINE_MAX];
+  CHAR8      *Tok[CMD_TOKEN_MAX];
+  UINTN      n;
 
-  for (UINTN i = 0; i < HexDigits; ) {
-    if (EFI_ERROR(gST->ConIn->ReadKeyStroke(gST->ConIn, &Key))) continue;
+  gST->ConOut->ClearScreen(gST->ConOut);
+  PrintParenGreen(L"Snapshots");
+  Print(L"\n");
+  SnapList();
+  Print(L"\n");
 
-    if (Key.ScanCode == SCAN_ESC || Key.UnicodeChar == CHAR_CARRIAGE_RETURN) {
-      Print(L"\nCanceled.\n");
-      return EFI_ABORTED;
-    }
+  Status = ReadLineFromKeyboard(L"diff <id> <id> | revert <id>, ", Line, sizeof(Line));
+  if (EFI_ERROR(Status)) return Status;
 
-    if (HexCharToNibble(Key.UnicodeChar, &nib)) {
-      v = (v << 4) | (UINT32)nib;
-      Print(L"%c", Key.UnicodeChar);
-      i++;
-    }
-  }
+  n = AsciiTokenize(Line, Tok, CMD_TOKEN_MAX);
+  if (n == 0) return EFI_SUCCESS;
+  if (n > CMD_TOKEN_MAX) return EFI_INVALID_PARAMETER;
 
-  Print(L"\n");
-  *OutValue = v;
-  return EFI_SUCCESS;
+  Status = CmdSnap(n, Tok);
+  SyncDumpFromCache();
+  return Status;
 }
 
-// ENTER: write by display mode (1/2/4 bytes), LE, readback verify
+// H: stage a hex string at the cursor, commit it as one bulk write + one verify
 STATIC
 EFI_STATUS
-WriteByModeAtCursor (
+UiHexStringAtCursor (
   VOID
   )
 {
-  EFI_STATUS Status;
-  UINTN      size   = (UINTN)mDispMode;   // 1/2/4
-  UINTN      digits = size * 2;           // 2/4/8
-  UINT32     inputVal;
-  UINT8      addr   = mCursor;
-
-  if ((UINTN)addr + size - 1 > 0xFF) {
-    Print(L"\nWrite overflow: addr=0x%02x size=%u\n", addr, size);
-    return EFI_INVALID_PARAMETER;
-  }
+  STATIC BOOLEAN mHexReverse = FALSE;   // remembered between entries
+  EFI_STATUS     Status;
+  PLAN_STATS     St;
+  UINT8          Buf[256];
+  UINTN          Len;
 
-  Status = ReadHexValueNFromKeyboard(digits, &inputVal);
-  if (Status == EFI_ABORTED) return EFI_SUCCESS;
-  if (EFI_ERROR(Status)) return Status;
-
-  Status = EcSetBank(mBank);
+  Status = ReadHexStringFromKeyboard(256 - (UINTN)mCursor, Buf, &Len, &mHexReverse);
   if (EFI_ERROR(Status)) return Status;
 
-  // write LE bytes
-  for (UINTN i = 0; i < size; i++) {
-    UINT8 b = (UINT8)((inputVal >> (8 * i)) & 0xFF);
-    Status = EcWriteEeprom8((UINT8)(addr + i), b);
-    if (EFI_ERROR(Status)) return Status;
-  }
+  PlanClear(&mPlanBulk);
+  for (UINTN i = 0; i < Len; i++) PlanSet(&mPlanBulk, mBank, (UINTN)mCursor + i, Buf[i]);
 
-  // readback verify + update dump
-  for (UINTN i = 0; i < size; i++) {
-    UINT8 rb = 0;
-    UINT8 expect = (UINT8)((inputVal >> (8 * i)) & 0xFF);
+  SetMem(&St, sizeof(St), 0);
+  Status = PlanExecute(NULL, &mPlanBulk, TRUE, &St);
+  if (!EFI_ERROR(Status)) Status = PlanVerify(&mPlanBulk, &St);
 
-    Status = EcReadEeprom8((UINT8)(addr + i), &rb);
-    if (EFI_ERROR(Status)) return Status;
+  BulkReport(L"hex", Status, &St);
+  SyncDumpFromCache();
+  return Status;
+}
 
-    mDump[addr + i] = rb;
+// Redraw only the hex rows that overlap [Off, Off+Len), then put the
+// console cursor back where the prompt was
+STATIC
+VOID
+RedrawRows (
+  IN UINTN Off,
+  IN UINTN Len
+  )
+{
+  INT32 Col = gST->ConOut->Mode->CursorColumn;
+  INT32 Row = gST->ConOut->Mode->CursorRow;
 
-    if (rb != expect) {
-      Print(L"\nVerify fail @Bank%u Addr 0x%02x: expect 0x%02x read 0x%02x\n",
-            mBank, (UINT8)(addr + i), expect, rb);
-      return EFI_DEVICE_ERROR;
-    }
+  if (Len == 0) return;
+  for (UINTN r = Off / COLS; r <= (Off + Len - 1) / COLS && r < ROWS; r++) {
+    gST->ConOut->SetCursorPosition(gST->ConOut, 0, mRowLine[r]);
+    PrintRow(r);
   }
-
-  return EFI_SUCCESS;
+  gST->ConOut->SetCursorPosition(gST->ConOut, (UINTN)Col, (UINTN)Row);
 }
 
-// ---------------- Access toggles ----------------
+// Rebuild the preview from the typed text and the pad/terminator options
 STATIC
 VOID
-ApplyProfileForAccess (
-  VOID
+AsciiPreviewBuild (
+  IN CONST CHAR8 *Text,
+  IN UINTN       TextLen,
+  IN UINTN       Field,      // 0 = no padding
+  IN UINTN       PadIdx,
+  IN BOOLEAN     Nul
   )
 {
-  if (mEc.AccessType == ACCESS_INDEXIO_ENE) {
-    // ENE
-    mEc.IndexIoBase = 0xFD60;
-    mEc.OffIndexHigh= 0x01;
-    mEc.OffIndexLow = 0x02;
-    mEc.OffData     = 0x03;
+  UINTN n = 0;
 
-    mEc.CmdBuffer             = 0xF98B;
-    mEc.DataOfCmdBuffer       = 0xF98C;
-    mEc.CmdWriteDataBuffer    = 0xF98D;
-    mEc.CmdCntl               = 0xF982;
-    mEc.CmdReturnDataBuffer   = 0xF983;
+  for (UINTN i = 0; i < TextLen; i++) mPreview.Data[n++] = (UINT8)Text[i];
+  if (Nul) mPreview.Data[n++] = 0;
+  while (n < Field) mPreview.Data[n++] = mAsciiPad[PadIdx];
+  mPreview.Len = (UINT16)n;
+}
 
-    // Your doc: WriteAddr / ReadAddr / Bank share buffer in this mapping
-    mEc.BankBuf               = mEc.CmdWriteDataBuffer;
-    mEc.ReadAddrBuf           = mEc.CmdWriteDataBuffer;
-    mEc.WriteAddrBuf          = mEc.CmdWriteDataBuffer;
-    mEc.WriteDataBuf          = (UINT16)(mEc.CmdWriteDataBuffer + 1);
+// A: type an ASCII string at the cursor with live preview in the ASCII
+// column; optional padding to a field length and NUL terminator.
+// Commit = one elided bulk write + one verify.
+STATIC
+EFI_STATUS
+UiAsciiAtCursor (
+  VOID
+  )
+{
+  EFI_STATUS    Status;
+  EFI_INPUT_KEY Key;
+  PLAN_STATS    St;
+  CHAR8         Line[CMD_LINE_MAX];
+  CHAR8         Text[256];
+  UINTN         TextLen = 0;
+  UINTN         Room    = 256 - (UINTN)mCursor;
+  UINTN         Field   = 0;
+  UINTN         PadIdx  = 0;
+  BOOLEAN       Nul     = FALSE;
+  UINTN         OldLen;
+
+  Status = ReadLineFromKeyboard(L"Field length in bytes (hex, empty = no padding), ", Line, sizeof(Line));
+  if (EFI_ERROR(Status)) return Status;
+  if (Line[0] != 0 && (!AsciiParseHex(Line, Room, &Field) || Field == 0)) return EFI_INVALID_PARAMETER;
 
-  } else if (mEc.AccessType == ACCESS_INDEXIO_NUVOTON) {
-    // Nuvoton
-    mEc.IndexIoBase = 0x0A00;
-    mEc.OffIndexHigh= 0x00;
-    mEc.OffIndexLow = 0x01;
-    mEc.OffData     = 0x02;
+  Render();
+  Print(L"\n");
+  PrintParenGreen(L"F1");
+  Print(L" pad, ");
+  PrintParenGreen(L"F2");
+  Print(L" NUL, ");
+  PrintParenGreen(L"ENTER");
+  Print(L" commit, ");
+  PrintParenGreen(L"ESC");
+  Print(L" cancel\n[pad=%s nul=%s] ", mAsciiPadName[PadIdx], Nul ? L"on" : L"off");
+
+  mPreview.Active = TRUE;
+  mPreview.Off    = mCursor;
+  AsciiPreviewBuild(Text, TextLen, Field, PadIdx, Nul);
+  RedrawRows(mPreview.Off, mPreview.Len);
 
-    mEc.CmdBuffer             = 0x128B;
-    mEc.DataOfCmdBuffer       = 0x128C;
-    mEc.CmdWriteDataBuffer    = 0x128D;
-    mEc.CmdCntl               = 0x1282;
-    mEc.CmdReturnDataBuffer   = 0x1283;
+  while (TRUE) {
+    BOOLEAN Redraw = FALSE;
 
-    mEc.BankBuf               = mEc.CmdWriteDataBuffer;
-    mEc.ReadAddrBuf           = mEc.CmdWriteDataBuffer;
-    mEc.WriteAddrBuf          = mEc.CmdWriteDataBuffer;
-    mEc.WriteDataBuf          = (UINT16)(mEc.CmdWriteDataBuffer + 1);
+    if (EFI_ERROR(gST->ConIn->ReadKeyStroke(gST->ConIn, &Key))) continue;
 
-  } else if (mEc.AccessType == ACCESS_INDEXIO_ITE) {
-    // ITE (你提供的 Base/EC RAM mapping)
-    mEc.IndexIoBase = 0x0D00;
-    mEc.OffIndexHigh= 0x01;
-    mEc.OffIndexLow = 0x02;
-    mEc.OffData     = 0x03;
+    if (Key.ScanCode == SCAN_ESC) {
+      mPreview.Active = FALSE;
+      Print(L"\nCanceled.\n");
+      return EFI_ABORTED;
+    }
+    if (Key.UnicodeChar == CHAR_CARRIAGE_RETURN) break;
+
+    if (Key.ScanCode == SCAN_F1 || Key.ScanCode == SCAN_F2) {
+      if (Key.ScanCode == SCAN_F1) PadIdx = (PadIdx + 1) % ARRAY_SIZE(mAsciiPad);
+      else if (TextLen + 1 <= ((Field != 0) ? Field : Room)) Nul = (BOOLEAN)!Nul;
+      Print(L"\n[pad=%s nul=%s] ", mAsciiPadName[PadIdx], Nul ? L"on" : L"off");
+      for (UINTN i = 0; i < TextLen; i++) Print(L"%c", (CHAR16)Text[i]);
+      Redraw = TRUE;
+    } else if (Key.UnicodeChar == CHAR_BACKSPACE) {
+      if (TextLen > 0) {
+        TextLen--;
+        Print(L"\b \b");
+        Redraw = TRUE;
+      }
+    } else if (Key.UnicodeChar >= 0x20 && Key.UnicodeChar <= 0x7E &&
+               TextLen + (Nul ? 1 : 0) < ((Field != 0) ? Field : Room)) {
+      Text[TextLen++] = (CHAR8)Key.UnicodeChar;
+      Print(L"%c", Key.UnicodeChar);
+      Redraw = TRUE;
+    }
 
-    mEc.CmdBuffer             = 0xC62B;
-    mEc.DataOfCmdBuffer       = 0xC62C;
-    mEc.CmdWriteDataBuffer    = 0xC62D;
-    mEc.CmdCntl               = 0xC622;
-    mEc.CmdReturnDataBuffer   = 0xC623;
+    if (Redraw) {
+      OldLen = mPreview.Len;
+      AsciiPreviewBuild(Text, TextLen, Field, PadIdx, Nul);
+      RedrawRows(mPreview.Off, MAX(OldLen, (UINTN)mPreview.Len));
+    }
+  }
 
-    mEc.BankBuf               = mEc.CmdWriteDataBuffer;
-    mEc.ReadAddrBuf           = mEc.CmdWriteDataBuffer;
-    mEc.WriteAddrBuf          = mEc.CmdWriteDataBuffer;
-    mEc.WriteDataBuf          = (UINT16)(mEc.CmdWriteDataBuffer + 1);
+  Print(L"\n");
+  if (mPreview.Len == 0) {
+    mPreview.Active = FALSE;
+    return EFI_SUCCESS;
   }
-}
 
-STATIC
-VOID
-CycleAccess (
-  VOID
-  )
-{
-  if (mEc.AccessType == ACCESS_PORTIO) mEc.AccessType = ACCESS_INDEXIO_ENE;
-  else if (mEc.AccessType == ACCESS_INDEXIO_ENE) mEc.AccessType = ACCESS_INDEXIO_NUVOTON;
-  else if (mEc.AccessType == ACCESS_INDEXIO_NUVOTON) mEc.AccessType = ACCESS_INDEXIO_ITE;
-  else mEc.AccessType = ACCESS_PORTIO;
+  PlanClear(&mPlanBulk);
+  for (UINTN i = 0; i < mPreview.Len; i++) PlanSet(&mPlanBulk, mBank, mPreview.Off + i, mPreview.Data[i]);
+  mPreview.Active = FALSE;
 
-  ApplyProfileForAccess();
+  SetMem(&St, sizeof(St), 0);
+  Status = PlanExecute(NULL, &mPlanBulk, TRUE, &St);
+  if (!EFI_ERROR(Status)) Status = PlanVerify(&mPlanBulk, &St);
+
+  BulkReport(L"ascii", Status, &St);
+  SyncDumpFromCache();
+  return Status;
 }
 
 // =======================================================
-//                       Entry
+//                  Interactive editor
 // =======================================================
+STATIC
 EFI_STATUS
-EFIAPI
-UefiMain (
-  IN EFI_HANDLE        ImageHandle,
-  IN EFI_SYSTEM_TABLE  *SystemTable
+UiMain (
+  VOID
   )
 {
   EFI_STATUS    Status;
   EFI_INPUT_KEY Key;
 
-  mAttrDefault = gST->ConOut->Mode->Attribute;
-
-  // Default: PortIO 62/66
-  SetMem(&mEc, sizeof(mEc), 0);
-  mEc.AccessType = ACCESS_PORTIO;
-  mEc.PortMode   = PORTMODE_ACPI_62_66;
-  ApplyProfileForAccess();
-
   SetMem(mDump, sizeof(mDump), 0xFF);
 
-  Status = RefreshDump();
-  if (EFI_ERROR(Status)) {
-    Print(L"Initial refresh failed: %r\n", Status);
-    Print(L"Hint: try ");
-    PrintParenGreen(L"F1");
-    Print(L"/");
-    PrintParenGreen(L"F2");
-    Print(L" to switch Port (PortIO), or ");
-    PrintParenGreen(L"I");
-    Print(L" to switch Access.\n");
-    return Status;
-  }
+  // The UI touches the EC right away: pick the profile for the first frame
+  ChipSelectProfile();
+  if (!DecodeBackendRouted()) CycleAccess();
 
+  // First frame before any EC I/O: a dead backend must not delay or end the UI
+  RefreshStart(LOG_PROBE_FAILED, 0);
   AlignCursorToMode();
   Render();
 
   while (TRUE) {
-    if (EFI_ERROR(gST->ConIn->ReadKeyStroke(gST->ConIn, &Key))) continue;
+    if (EFI_ERROR(gST->ConIn->ReadKeyStroke(gST->ConIn, &Key))) {
+      IdleStep();
+      LogSinkFlush(FALSE);
+      if (mNeedRender) {
+        mNeedRender = FALSE;
+        Render();
+      }
+      continue;
+    }
 
     // ESC
     if (Key.ScanCode == SCAN_ESC) break;
 
+    // E: EEPROM <-> EC RAM view
+    if (Key.UnicodeChar == L'E' || Key.UnicodeChar == L'e') {
+      mView = (mView == VIEW_EEPROM) ? VIEW_ECRAM : VIEW_EEPROM;
+      RamClampView();
+      Render();
+      continue;
+    }
+
+    // EC RAM view owns the movement keys and R; the rest falls through
+    if (mView == VIEW_ECRAM) {
+      BOOLEAN Used = TRUE;
+      UINT32  Page = ROWS * COLS;
+
+      if (Key.ScanCode == SCAN_UP)             mRamCursor = (mRamCursor >= COLS) ? mRamCursor - COLS : mRamCursor;
+      else if (Key.ScanCode == SCAN_DOWN)      mRamCursor += COLS;
+      else if (Key.ScanCode == SCAN_LEFT)      mRamCursor = (mRamCursor > 0) ? mRamCursor - 1 : 0;
+      else if (Key.ScanCode == SCAN_RIGHT)     mRamCursor += 1;
+      else if (Key.ScanCode == SCAN_PAGE_UP)   { mRamCursor = (mRamCursor >= Page) ? mRamCursor - Page : mRamCursor % COLS;
+                                                 mRamTop    = (mRamTop >= ROWS) ? mRamTop - ROWS : 0; }
+      else if (Key.ScanCode == SCAN_PAGE_DOWN) { mRamCursor += Page; mRamTop += ROWS; }
+      else if (Key.UnicodeChar == L'R' || Key.UnicodeChar == L'r') { RamPagesInvalidate(); mRamReadAheadHold = FALSE; }
+      else if (Key.UnicodeChar == CHAR_CARRIAGE_RETURN || Key.UnicodeChar == CHAR_TAB) {
+        LOG0(LOG_WARN, LOG_ECRAM_READ_ONLY);
+        Render();
+        continue;
+      } else Used = FALSE;
+
+      if (Used) {
+        RamClampView();
+        Render();
+        continue;
+      }
+    }
+
     // Bank switch PgUp/PgDn
     if (Key.ScanCode == SCAN_PAGE_UP) {
       mBank = (mBank == 0) ? EEPROM_BANK_MAX : (UINT8)(mBank - 1);
-      Status = RefreshDump();
+      Status = LoadBankDump();
+      if (EFI_ERROR(Status)) LOG2(LOG_ERROR, LOG_BANK_SWITCH_FAILED, mBank, Status);
       AlignCursorToMode();
       Render();
-      if (EFI_ERROR(Status)) Print(L"\nSwitch bank failed: %r\n", Status);
       continue;
     }
 
     if (Key.ScanCode == SCAN_PAGE_DOWN) {
       mBank = (mBank >= EEPROM_BANK_MAX) ? 0 : (UINT8)(mBank + 1);
-      Status = RefreshDump();
+      Status = LoadBankDump();
+      if (EFI_ERROR(Status)) LOG2(LOG_ERROR, LOG_BANK_SWITCH_FAILED, mBank, Status);
       AlignCursorToMode();
       Render();
-      if (EFI_ERROR(Status)) Print(L"\nSwitch bank failed: %r\n", Status);
       continue;
     }
 
@@ -966,13 +7489,12 @@ UefiMain (
     if (Key.ScanCode == SCAN_F1) {
       if (mEc.AccessType == ACCESS_PORTIO) {
         mEc.PortMode = PORTMODE_8042_60_64;
-        Status = RefreshDump();
+        RefreshStart(LOG_PORT_SWITCH_FAILED, 0x60);
         AlignCursorToMode();
         Render();
-        if (EFI_ERROR(Status)) Print(L"\nSwitch to 60/64 failed: %r\n", Status);
       } else {
+        LOG0(LOG_WARN, LOG_PORTIO_ONLY);
         Render();
-        Print(L"\nF1 only works in PortIO mode.\n");
       }
       continue;
     }
@@ -981,13 +7503,12 @@ UefiMain (
     if (Key.ScanCode == SCAN_F2) {
       if (mEc.AccessType == ACCESS_PORTIO) {
         mEc.PortMode = PORTMODE_ACPI_62_66;
-        Status = RefreshDump();
+        RefreshStart(LOG_PORT_SWITCH_FAILED, 0x62);
         AlignCursorToMode();
         Render();
-        if (EFI_ERROR(Status)) Print(L"\nSwitch to 62/66 failed: %r\n", Status);
       } else {
+        LOG0(LOG_WARN, LOG_PORTIO_ONLY);
         Render();
-        Print(L"\nF2 only works in PortIO mode.\n");
       }
       continue;
     }
@@ -995,39 +7516,135 @@ UefiMain (
     // I: cycle access backend
     if (Key.UnicodeChar == L'I' || Key.UnicodeChar == L'i') {
       CycleAccess();
-      Status = RefreshDump();
+      RefreshStart(LOG_ACCESS_REFRESH_FAILED, 0);
       AlignCursorToMode();
       Render();
-      if (EFI_ERROR(Status)) Print(L"\nAccess switch refresh failed: %r\n", Status);
+      continue;
+    }
+
+    // F: fill from cursor / C: bank-to-bank copy / H: hex string / A: ASCII string / N: snapshots
+    if (Key.UnicodeChar == L'F' || Key.UnicodeChar == L'f' ||
+        Key.UnicodeChar == L'C' || Key.UnicodeChar == L'c' ||
+        Key.UnicodeChar == L'H' || Key.UnicodeChar == L'h' ||
+        Key.UnicodeChar == L'A' || Key.UnicodeChar == L'a' ||
+        Key.UnicodeChar == L'N' || Key.UnicodeChar == L'n') {
+      CHAR16 k = (CHAR16)(Key.UnicodeChar | 0x20);
+      Status = (k == L'f') ? UiFillAtCursor() :
+               (k == L'c') ? UiCopy() :
+               (k == L'h') ? UiHexStringAtCursor() :
+               (k == L'n') ? UiSnapshots() : UiAsciiAtCursor();
+      if (Status == EFI_INVALID_PARAMETER) Print(L"Bad arguments.\n");
+      Print(L"Press any key to return.\n");
+      while (EFI_ERROR(gST->ConIn->ReadKeyStroke(gST->ConIn, &Key)));
+      Render();
+      continue;
+    }
+
+    // S: scrub bandwidth cap
+    if (Key.UnicodeChar == L'S' || Key.UnicodeChar == L's') {
+      UINTN i;
+      for (i = 0; i < ARRAY_SIZE(mScrubRates) && mScrubRates[i] != mScrubRate; i++);
+      mScrubRate = mScrubRates[(i + 1) % ARRAY_SIZE(mScrubRates)];
+      Render();
+      continue;
+    }
+
+    // V: vote mode (majority-read suspect bytes)
+    if (Key.UnicodeChar == L'V' || Key.UnicodeChar == L'v') {
+      mVote = (BOOLEAN)!mVote;
+      Render();
+      continue;
+    }
+
+    // L: event log
+    if (Key.UnicodeChar == L'L' || Key.UnicodeChar == L'l') {
+      RenderLog();
+      while (EFI_ERROR(gST->ConIn->ReadKeyStroke(gST->ConIn, &Key))) IdleStep();
+      Render();
+      continue;
+    }
+
+    // D: diagnostics
+    if (Key.UnicodeChar == L'D' || Key.UnicodeChar == L'd') {
+      RenderDiag();
+      while (EFI_ERROR(gST->ConIn->ReadKeyStroke(gST->ConIn, &Key))) IdleStep();
+      Render();
       continue;
     }
 
     // R: refresh
     if (Key.UnicodeChar == L'R' || Key.UnicodeChar == L'r') {
       Status = RefreshDump();
+      if (EFI_ERROR(Status)) LOG1(LOG_ERROR, LOG_REFRESH_FAILED, Status);
       AlignCursorToMode();
       Render();
-      if (EFI_ERROR(Status)) Print(L"\nRefresh failed: %r\n", Status);
       continue;
     }
 
     // ENTER: write by mode
     if (Key.UnicodeChar == CHAR_CARRIAGE_RETURN) {
       Status = WriteByModeAtCursor();
-      Render();
       if (EFI_ERROR(Status)) {
-        Print(L"\nWrite failed @Bank%u Addr 0x%02x (size=%u): %r\n",
-              mBank, mCursor, (UINTN)mDispMode, Status);
+        LogEvent(LOG_ERROR, LOG_WRITE_FAILED, mBank, mCursor, mDispMode, Status, 0);
       } else {
-        Print(L"\nWrite OK @Bank%u Addr 0x%02x (size=%u)\n",
-              mBank, mCursor, (UINTN)mDispMode);
+        SnapTake(mBank);
+        LOG4(LOG_INFO, LOG_WRITE_OK, mBank, mCursor, mDispMode, 0);
       }
+      Render();
       continue;
     }
   }
 
+  LogSinkFlush(TRUE);
+  if (mLogOut.Fh != NULL) ShellCloseFile(&mLogOut.Fh);
+
   AttrDefault();
   gST->ConOut->ClearScreen(gST->ConOut);
   Print(L"Exit EEPROMECApp.\n");
   return EFI_SUCCESS;
 }
+#endif // EEPROMEC_CLI_ONLY
+
+// =======================================================
+//                       Entry
+// =======================================================
+EFI_STATUS
+EFIAPI
+UefiMain (
+  IN EFI_HANDLE        ImageHandle,
+  IN EFI_SYSTEM_TABLE  *SystemTable
+  )
+{
+  EFI_STATUS Status;
+  BOOLEAN    CliHandled;
+
+  mEntryTsc = AsmReadTsc();
+#ifndef EEPROMEC_CLI_ONLY
+  mAttrDefault = gST->ConOut->Mode->Attribute;
+#endif
+  TimeInit();
+  HexTableInit();
+  DecodeInit();
+  LatInit();
+
+  // Default: PortIO 62/66
+  SetMem(&mEc, sizeof(mEc), 0);
+  mEc.AccessType = ACCESS_PORTIO;
+  mEc.PortMode   = PORTMODE_ACPI_62_66;
+  ApplyProfileForAccess();
+
+  CacheInvalidateAll();
+
+  // Arguments given: run them and exit without the UI
+  Status = CliMain(ImageHandle, &CliHandled);
+  if (CliHandled) return Status;
+
+#ifdef EEPROMEC_CLI_ONLY
+  // No editor in this build: a command is required
+  if (mLogOut.Fh != NULL) ShellCloseFile(&mLogOut.Fh);
+  CliUsage();
+  return EFI_INVALID_PARAMETER;
+#else
+  return UiMain();
+#endif
+}